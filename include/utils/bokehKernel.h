@@ -0,0 +1,136 @@
+/*
+Complex kernels for the separable circular bokeh (DOFCircular)
+- a circular disc is approximated by the sum of 1 to 3 components: each component is a 1D complex Gaussian f(x) = exp(-a x^2) (cos(b x^2) + i sin(b x^2)), applied horizontally and then vertically,
+  and the result of the component is A * real part + B * imaginary part (Niemitalo, "Circularly symmetric convolution and lens blur", 2018; Garcia, "Circular separable convolution depth of field", 2017)
+- more components give a sharper border of the disc, and less ringing inside it
+
+The kernels are sampled at 2 * BOKEH_RADIUS + 1 taps (x between -1 and 1), and scaled so that the 2D kernel has sum 1.
+They are uploaded in a Uniform Buffer Object read by the DOF subroutines of the blur shaders.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// radius of the kernels in texels (BLUR_SIZE in the blur shaders), and maximum number of components
+#define BOKEH_RADIUS 15
+#define BOKEH_MAX_COMPONENTS 3
+#define BOKEH_KERNEL_SIZE (2 * BOKEH_RADIUS + 1)
+// binding point of the Uniform Buffer Object (it must match the blur shaders)
+#define BOKEH_KERNEL_BINDING 1
+
+// parameters of a component: exp(-a x^2) is the envelope, b the frequency, A and B the weights of the real and imaginary part
+struct BokehComponent {
+    float a, b, A, B;
+};
+
+// fitted parameters for 1, 2 and 3 components
+static const BokehComponent bokehComponents[BOKEH_MAX_COMPONENTS][BOKEH_MAX_COMPONENTS] = {
+    {{0.862325f, 1.624835f, 0.767583f, 1.862321f}, {0, 0, 0, 0}, {0, 0, 0, 0}},
+    {{0.886528f, 5.268909f, 0.411259f, -0.548794f}, {1.960518f, 1.558213f, 0.513282f, 4.561110f}, {0, 0, 0, 0}},
+    {{2.176490f, 5.043495f, 1.621035f, -2.105439f}, {1.019306f, 9.027613f, -0.280860f, -0.162882f}, {2.815269f, 1.597273f, -0.366471f, 10.300301f}}
+};
+
+class BokehKernel
+{
+public:
+    // components currently in the buffer, and sum of the 2D kernel they produce (1 after the normalization)
+    int components;
+    float kernelSum;
+
+    BokehKernel(): components(0), kernelSum(0.0f), ubo(0) {}
+
+    BokehKernel(const BokehKernel& copy) = delete;
+    BokehKernel& operator=(const BokehKernel& copy) = delete;
+
+    //////////////////////////////////////////
+    // kernels of the components (real and imaginary part of each tap), normalized so that the 2D kernel has sum 1
+    static vector<glm::vec2> Build(int components)
+    {
+        const BokehComponent* params = bokehComponents[components - 1];
+        vector<glm::vec2> kernel(components * BOKEH_KERNEL_SIZE);
+        for(int c = 0; c < components; c++)
+            for(int i = 0; i < BOKEH_KERNEL_SIZE; i++){
+                float x = (float)(i - BOKEH_RADIUS) / BOKEH_RADIUS;
+                float envelope = exp(-params[c].a * x * x);
+                kernel[c * BOKEH_KERNEL_SIZE + i] = envelope * glm::vec2(cos(params[c].b * x * x), sin(params[c].b * x * x));
+            }
+        // the same scale is applied to the horizontal and to the vertical kernel
+        float scale = 1.0f / sqrt(Sum(kernel, components));
+        for(size_t i = 0; i < kernel.size(); i++)
+            kernel[i] *= scale;
+        return kernel;
+    }
+
+    // sum of the 2D kernel: for each component, A * Re + B * Im of the product of the horizontal and vertical taps
+    static float Sum(const vector<glm::vec2>& kernel, int components)
+    {
+        const BokehComponent* params = bokehComponents[components - 1];
+        float sum = 0.0f;
+        for(int c = 0; c < components; c++)
+            for(int x = 0; x < BOKEH_KERNEL_SIZE; x++)
+                for(int y = 0; y < BOKEH_KERNEL_SIZE; y++){
+                    glm::vec2 p = kernel[c * BOKEH_KERNEL_SIZE + x];
+                    glm::vec2 q = kernel[c * BOKEH_KERNEL_SIZE + y];
+                    sum += params[c].A * (p.x * q.x - p.y * q.y) + params[c].B * (p.x * q.y + p.y * q.x);
+                }
+        return sum;
+    }
+
+    //////////////////////////////////////////
+    // it creates the Uniform Buffer Object, and binds it to BOKEH_KERNEL_BINDING
+    void Init()
+    {
+        glGenBuffers(1, &this->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(KernelBlock), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, BOKEH_KERNEL_BINDING, this->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void Update(int components)
+    {
+        components = std::max(1, std::min(components, BOKEH_MAX_COMPONENTS));
+        if(components == this->components || !this->ubo)
+            return;
+        vector<glm::vec2> kernel = Build(components);
+        // std140 layout: the int is padded to 16 bytes, and each element of the arrays is a vec4
+        KernelBlock block;
+        memset(&block, 0, sizeof(block));
+        block.components = components;
+        for(int c = 0; c < components; c++)
+            block.weights[c] = glm::vec4(bokehComponents[components - 1][c].A, bokehComponents[components - 1][c].B, 0.0f, 0.0f);
+        for(size_t i = 0; i < kernel.size(); i++)
+            block.kernel[i] = glm::vec4(kernel[i], 0.0f, 0.0f);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(KernelBlock), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        this->components = components;
+        this->kernelSum = Sum(kernel, components);
+    }
+
+    void Release()
+    {
+        if(this->ubo)
+            glDeleteBuffers(1, &this->ubo);
+        this->ubo = 0;
+    }
+
+private:
+    struct KernelBlock {
+        GLint components;
+        GLint padding[3];
+        glm::vec4 weights[BOKEH_MAX_COMPONENTS];
+        glm::vec4 kernel[BOKEH_MAX_COMPONENTS * BOKEH_KERNEL_SIZE];
+    };
+
+    GLuint ubo;
+};
@@ -43,23 +43,24 @@ public:
     }
     ~GameObject();
     void Draw(glm::mat4 view,Shader shader){
+        SetUniforms(view, shader.Program);
+        // we render the model
+        // N.B.) if the number of models is relatively low, this approach (we render the same mesh several time from the same buffers) can work. If we must render hundreds or more of copies of the same mesh,
+        // there are more advanced techniques to manage Instanced Rendering (see https://learnopengl.com/#!Advanced-OpenGL/Instancing for examples).
+        for(GLuint i = 0; i < model->meshes.size(); i++){
+            model->meshes[i].SetDecodeUniforms(shader.Program);
+            model->meshes[i].Draw();
+        }
+    }
+
+    // it returns the model matrix of the object, taken from the rigid body if present
+    glm::mat4 ModelMatrix(){
         GLfloat matrix[16];
         btTransform transform;
-        GLint objDiffuseLocation = glGetUniformLocation(shader.Program, "diffuseColor");
-         // we determine the position in the Shader Program of the uniform variables
-        GLint shineLocation = glGetUniformLocation(shader.Program, "shininess");
-        GLint alphaLocation = glGetUniformLocation(shader.Program, "alpha");
-        GLint f0Location = glGetUniformLocation(shader.Program, "F0");
-        glUniform1f(shineLocation, shininess);
-        glUniform1f(alphaLocation, alpha);
-        glUniform1f(f0Location, F0);
-        glUniform3fv(objDiffuseLocation, 1, color);
-        // we take the transformation matrix of the rigid boby, as calculated by the physics engine
-        
         // we reset to identity at each frame
         glm::mat4 objModelMatrix = glm::mat4(1.0f);
-        glm::mat3 objNormalMatrix = glm::mat3(1.0f);
         if(rb!=nullptr){
+            // we take the transformation matrix of the rigid boby, as calculated by the physics engine
             rb->getMotionState()->getWorldTransform(transform);
             // we convert the Bullet matrix (transform) to an array of floats
             transform.getOpenGLMatrix(matrix);
@@ -67,23 +68,33 @@ public:
             // 1) we convert the array of floats to a GLM mat4 (using make_mat4 method)
             // 2) Bullet matrix provides rotations and translations: it does not consider scale (usually the Collision Shape is generated using directly the scaled dimensions). If, like in our case, we have applied a scale to the original model, we need to multiply the scale to the rototranslation matrix created in 1). If we are working on an imported and not scaled model, we do not need to do this
             objModelMatrix = glm::make_mat4(matrix) * glm::scale(objModelMatrix, scale);
-            // we create the normal matrix
-            objNormalMatrix = glm::inverseTranspose(glm::mat3(view*objModelMatrix));
         }
         else{
             objModelMatrix = glm::translate(objModelMatrix, position);
             objModelMatrix = glm::rotate(objModelMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
             objModelMatrix = glm::scale(objModelMatrix, scale);
-            // if we cast a mat4 to a mat3, we are automatically considering the upper left 3x3 submatrix
-            objNormalMatrix = glm::inverseTranspose(glm::mat3(view*objModelMatrix));
         }
-        glUniformMatrix4fv(glGetUniformLocation(shader.Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(objModelMatrix));
-        glUniformMatrix3fv(glGetUniformLocation(shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(objNormalMatrix));
+        return objModelMatrix;
+    }
 
-        // we render the model
-        // N.B.) if the number of models is relatively low, this approach (we render the same mesh several time from the same buffers) can work. If we must render hundreds or more of copies of the same mesh,
-        // there are more advanced techniques to manage Instanced Rendering (see https://learnopengl.com/#!Advanced-OpenGL/Instancing for examples).
-        model->Draw();
+    // it sets the per-object uniforms (material and transformations) in the currently active Shader Program
+    void SetUniforms(glm::mat4 view, GLuint program){
+        GLint objDiffuseLocation = glGetUniformLocation(program, "diffuseColor");
+         // we determine the position in the Shader Program of the uniform variables
+        GLint shineLocation = glGetUniformLocation(program, "shininess");
+        GLint alphaLocation = glGetUniformLocation(program, "alpha");
+        GLint f0Location = glGetUniformLocation(program, "F0");
+        glUniform1f(shineLocation, shininess);
+        glUniform1f(alphaLocation, alpha);
+        glUniform1f(f0Location, F0);
+        glUniform3fv(objDiffuseLocation, 1, color);
+
+        glm::mat4 objModelMatrix = ModelMatrix();
+        // we create the normal matrix
+        // if we cast a mat4 to a mat3, we are automatically considering the upper left 3x3 submatrix
+        glm::mat3 objNormalMatrix = glm::inverseTranspose(glm::mat3(view*objModelMatrix));
+        glUniformMatrix4fv(glGetUniformLocation(program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(objModelMatrix));
+        glUniformMatrix3fv(glGetUniformLocation(program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(objNormalMatrix));
     }
 
     void addRigidbody(Physics bulletSimulation, int type,float mass, float friction, float restitution){
@@ -0,0 +1,165 @@
+/*
+Gaussian kernels for the separable blur, generated at runtime for any sigma and radius
+- the discrete kernel has 2 * radius + 1 weights, normalized to sum 1
+- the linear kernel merges each pair of adjacent weights in a single tap, placed between the two texels so that the bilinear filtering of the texture unit returns their weighted sum (Rákos, "Efficient Gaussian blur with linear sampling", 2010): the fetches become 1 + 2 * ceil(radius / 2)
+
+The linear taps are uploaded in a Uniform Buffer Object read by the GaussianBlur subroutine of the blur shaders, together with the discrete weights (used by the compute blur, which reads the taps from shared memory).
+ReferenceError convolves a random signal with both kernels on the CPU (clamping at the borders like GL_CLAMP_TO_EDGE), and returns the largest difference between the two results.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <cstring>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// maximum number of taps of the linear kernel (it must match the blur shaders): the largest radius is 2 * (GAUSSIAN_MAX_TAPS - 1)
+#define GAUSSIAN_MAX_TAPS 32
+// binding point of the Uniform Buffer Object (it must match the blur shaders)
+#define GAUSSIAN_KERNEL_BINDING 0
+
+// a fetch of the linear kernel: offset in texels from the center, and weight (the center tap and the symmetric ones share the weight)
+struct KernelTap {
+    float offset;
+    float weight;
+};
+
+class GaussianKernel
+{
+public:
+    // taps currently in the buffer
+    int radius;
+    int tapCount;
+
+    GaussianKernel(): radius(0), tapCount(0), ubo(0) {}
+
+    GaussianKernel(const GaussianKernel& copy) = delete;
+    GaussianKernel& operator=(const GaussianKernel& copy) = delete;
+
+    //////////////////////////////////////////
+    // half of the discrete kernel, from the center (index 0) to the border (index radius)
+    static vector<float> Discrete(float sigma, int radius)
+    {
+        vector<float> weights(radius + 1);
+        float sum = 0.0f;
+        for(int i = 0; i <= radius; i++){
+            weights[i] = exp(-(float)(i * i) / (2.0f * sigma * sigma));
+            sum += (i == 0) ? weights[i] : 2.0f * weights[i];
+        }
+        for(int i = 0; i <= radius; i++)
+            weights[i] /= sum;
+        return weights;
+    }
+
+    // the center is fetched alone, then the texels (1, 2), (3, 4), ... are merged: with an odd radius, the last texel is fetched alone
+    static vector<KernelTap> Linear(const vector<float>& discrete)
+    {
+        vector<KernelTap> taps;
+        KernelTap center = {0.0f, discrete[0]};
+        taps.push_back(center);
+        int radius = (int)discrete.size() - 1;
+        for(int i = 1; i <= radius; i += 2){
+            float w1 = discrete[i];
+            float w2 = (i + 1 <= radius) ? discrete[i + 1] : 0.0f;
+            KernelTap tap;
+            tap.weight = w1 + w2;
+            tap.offset = tap.weight > 0.0f ? (i * w1 + (i + 1) * w2) / tap.weight : (float)i;
+            taps.push_back(tap);
+        }
+        return taps;
+    }
+
+    //////////////////////////////////////////
+    // CPU reference: the linear kernel, sampling the signal with linear interpolation, must give the same result of the discrete kernel
+    static float ReferenceError(float sigma, int radius, int length = 256)
+    {
+        vector<float> discrete = Discrete(sigma, radius);
+        vector<KernelTap> taps = Linear(discrete);
+
+        std::mt19937 generator(1234);
+        std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+        vector<float> signal(length);
+        for(int i = 0; i < length; i++)
+            signal[i] = distribution(generator);
+
+        // the texture is sampled at texel centers, so texel x is at coordinate x
+        auto texel = [&](int x) { return signal[std::max(0, std::min(length - 1, x))]; };
+        auto sample = [&](float x) {
+            int x0 = (int)floor(x);
+            float t = x - x0;
+            return texel(x0) * (1.0f - t) + texel(x0 + 1) * t;
+        };
+
+        float maxError = 0.0f;
+        for(int x = 0; x < length; x++){
+            float reference = 0.0f;
+            for(int i = -radius; i <= radius; i++)
+                reference += texel(x + i) * discrete[abs(i)];
+            float linear = sample((float)x) * taps[0].weight;
+            for(size_t t = 1; t < taps.size(); t++)
+                linear += (sample(x + taps[t].offset) + sample(x - taps[t].offset)) * taps[t].weight;
+            maxError = std::max(maxError, fabs(linear - reference));
+        }
+        return maxError;
+    }
+
+    //////////////////////////////////////////
+    // it creates the Uniform Buffer Object, and binds it to GAUSSIAN_KERNEL_BINDING
+    void Init()
+    {
+        glGenBuffers(1, &this->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(KernelBlock), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, GAUSSIAN_KERNEL_BINDING, this->ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    // the buffer is updated only if the radius changes
+    void Update(float sigma, int radius)
+    {
+        radius = std::max(1, std::min(radius, 2 * (GAUSSIAN_MAX_TAPS - 1)));
+        if(radius == this->radius || !this->ubo)
+            return;
+        vector<float> discrete = Discrete(sigma, radius);
+        vector<KernelTap> taps = Linear(discrete);
+        // std140 layout: the two ints are padded to 16 bytes, and each element of the arrays is a vec4 (the discrete weights are packed 4 by 4)
+        KernelBlock block;
+        memset(&block, 0, sizeof(block));
+        block.tapCount = (GLint)taps.size();
+        block.radius = radius;
+        for(size_t i = 0; i < taps.size(); i++)
+            block.taps[i] = glm::vec4(taps[i].offset, taps[i].weight, 0.0f, 0.0f);
+        for(int i = 0; i <= radius; i++)
+            block.weights[i / 4][i % 4] = discrete[i];
+        glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(KernelBlock), &block);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        this->radius = radius;
+        this->tapCount = (int)taps.size();
+    }
+
+    void Release()
+    {
+        if(this->ubo)
+            glDeleteBuffers(1, &this->ubo);
+        this->ubo = 0;
+    }
+
+private:
+    struct KernelBlock {
+        GLint tapCount;
+        GLint radius;
+        GLint padding[2];
+        glm::vec4 taps[GAUSSIAN_MAX_TAPS];
+        glm::vec4 weights[GAUSSIAN_MAX_TAPS / 2];
+    };
+
+    GLuint ubo;
+};
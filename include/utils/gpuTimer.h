@@ -0,0 +1,103 @@
+/*
+GpuTimer class
+- it measures the time spent by the GPU on a sequence of commands, with GL_TIME_ELAPSED queries
+- the result of a query is read some frames later (when it is available), so the application never waits for the GPU
+
+The queries are used in a ring: Begin/End use the next query of the ring, and Update collects the results of the completed ones.
+Only one GL_TIME_ELAPSED query can be active at a time, so the measured sections must not overlap.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+
+#include <glad/glad.h>
+
+// number of queries in the ring (frames of latency before reading a result)
+#define GPU_TIMER_QUERIES 4
+
+class GpuTimer
+{
+public:
+    // sum of the measured times (in milliseconds), and number of measures
+    double totalTime;
+    int samples;
+
+    GpuTimer(): totalTime(0.0), samples(0), next(0), running(false) {}
+
+    GpuTimer(const GpuTimer& copy) = delete;
+    GpuTimer& operator=(const GpuTimer& copy) = delete;
+
+    void Init()
+    {
+        this->queries.resize(GPU_TIMER_QUERIES);
+        glGenQueries(GPU_TIMER_QUERIES, this->queries.data());
+        this->pending.assign(GPU_TIMER_QUERIES, false);
+    }
+
+    void Release()
+    {
+        if(!this->queries.empty())
+            glDeleteQueries((GLsizei)this->queries.size(), this->queries.data());
+        this->queries.clear();
+        this->pending.clear();
+    }
+
+    // if all the queries are still waiting for their result, the measure is skipped
+    void Begin()
+    {
+        this->Update();
+        if(this->queries.empty() || this->pending[this->next])
+            return;
+        glBeginQuery(GL_TIME_ELAPSED, this->queries[this->next]);
+        this->running = true;
+    }
+
+    void End()
+    {
+        if(!this->running)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        this->pending[this->next] = true;
+        this->next = (this->next + 1) % GPU_TIMER_QUERIES;
+        this->running = false;
+    }
+
+    // the available results are added to the total, without waiting
+    void Update()
+    {
+        for(size_t i = 0; i < this->queries.size(); i++){
+            if(!this->pending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(this->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if(!available)
+                continue;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(this->queries[i], GL_QUERY_RESULT, &elapsed);
+            this->totalTime += elapsed / 1000000.0;
+            this->samples++;
+            this->pending[i] = false;
+        }
+    }
+
+    // average time in milliseconds since the last Reset
+    double Average()
+    {
+        return this->samples > 0 ? this->totalTime / this->samples : 0.0;
+    }
+
+    void Reset()
+    {
+        this->totalTime = 0.0;
+        this->samples = 0;
+    }
+
+private:
+    vector<GLuint> queries;
+    vector<bool> pending;
+    int next;
+    bool running;
+};
@@ -0,0 +1,114 @@
+/*
+HitRegions class
+- areas of the screen covered by the hits, used to restrict the blur passes when only the Splash mix is active
+- the screen is divided in a grid of HIT_REGION_TILES x HIT_REGION_TILES tiles: the tiles touched by the square around each hit with power > 0 are marked,
+  and the marked tiles are merged in rectangles (runs of tiles in a row, joined with the identical runs of the following rows)
+
+The rectangles are in texture coordinates; Pixels converts a rectangle (enlarged by the apron of a blur pass) into the pixels of a render target, for glScissor or for the dispatch of the compute blur.
+With no hit, there are no rectangles, and the blur passes can be skipped.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+// tiles for each side of the screen
+#define HIT_REGION_TILES 16
+
+// rectangle in texture coordinates
+struct HitRegion {
+    float x0, y0, x1, y1;
+};
+
+class HitRegions
+{
+public:
+    vector<HitRegion> rects;
+    // marked tiles in the last Build
+    int coveredTiles;
+
+    HitRegions(): coveredTiles(0) {}
+
+    //////////////////////////////////////////
+    // points: 2 coordinates for each hit; extent: half size of the square around a hit, in texture coordinates
+    void Build(const float* points, const float* powers, int count, float extent)
+    {
+        bool tiles[HIT_REGION_TILES][HIT_REGION_TILES] = {};
+        this->coveredTiles = 0;
+        for(int i = 0; i < count; i++){
+            if(powers[i] == 0)
+                continue;
+            int tx0 = Tile(points[2*i] - extent), tx1 = Tile(points[2*i] + extent);
+            int ty0 = Tile(points[2*i+1] - extent), ty1 = Tile(points[2*i+1] + extent);
+            for(int y = ty0; y <= ty1; y++)
+                for(int x = tx0; x <= tx1; x++){
+                    this->coveredTiles += tiles[y][x] ? 0 : 1;
+                    tiles[y][x] = true;
+                }
+        }
+
+        // runs of the current row: a run equal to one of the previous row extends its rectangle
+        this->rects.clear();
+        vector<int> open, next;
+        for(int y = 0; y < HIT_REGION_TILES; y++){
+            next.clear();
+            for(int x = 0; x < HIT_REGION_TILES; x++){
+                if(!tiles[y][x])
+                    continue;
+                int start = x;
+                while(x + 1 < HIT_REGION_TILES && tiles[y][x + 1])
+                    x++;
+                HitRegion run = {(float)start / HIT_REGION_TILES, (float)y / HIT_REGION_TILES, (float)(x + 1) / HIT_REGION_TILES, (float)(y + 1) / HIT_REGION_TILES};
+                int merged = -1;
+                for(size_t o = 0; o < open.size(); o++){
+                    HitRegion& r = this->rects[open[o]];
+                    if(r.x0 == run.x0 && r.x1 == run.x1){
+                        r.y1 = run.y1;
+                        merged = open[o];
+                        break;
+                    }
+                }
+                if(merged < 0){
+                    merged = (int)this->rects.size();
+                    this->rects.push_back(run);
+                }
+                next.push_back(merged);
+            }
+            open.swap(next);
+        }
+    }
+
+    bool Empty() const
+    {
+        return this->rects.empty();
+    }
+
+    // fraction of the screen covered by the rectangles
+    float Coverage() const
+    {
+        return (float)this->coveredTiles / (HIT_REGION_TILES * HIT_REGION_TILES);
+    }
+
+    //////////////////////////////////////////
+    // pixels of the rectangle enlarged by a margin (in texture coordinates) in a target of size width x height: (x, y, width, height), clamped to the target
+    static glm::ivec4 Pixels(const HitRegion& r, float marginX, float marginY, int width, int height)
+    {
+        int x0 = std::max(0, (int)floor((r.x0 - marginX) * width));
+        int y0 = std::max(0, (int)floor((r.y0 - marginY) * height));
+        int x1 = std::min(width, (int)ceil((r.x1 + marginX) * width));
+        int y1 = std::min(height, (int)ceil((r.y1 + marginY) * height));
+        return glm::ivec4(x0, y0, std::max(0, x1 - x0), std::max(0, y1 - y0));
+    }
+
+private:
+    static int Tile(float coordinate)
+    {
+        return std::max(0, std::min(HIT_REGION_TILES - 1, (int)floor(coordinate * HIT_REGION_TILES)));
+    }
+};
@@ -0,0 +1,125 @@
+/*
+JobSystem class
+- a pool of worker threads executing the jobs submitted by the application (e.g., decoding of images, import of models, rendering of glyphs)
+- a queue of tasks for the main thread, used by the jobs to hand their results (CPU buffers) to the thread owning the OpenGL context, which uploads them on the GPU
+
+The OpenGL context is current only on the main thread, so the jobs must never call OpenGL functions: everything related to OpenGL must be done in a task posted with PostToMainThread.
+The main thread executes the posted tasks calling ProcessMainThread once per frame, so the rendering can start before all the assets are available.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <queue>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class JobSystem
+{
+public:
+    // if workers = 0, we use a worker for each hardware thread, except the one of the main thread
+    JobSystem(unsigned int workers = 0): stopping(false), pendingJobs(0)
+    {
+        if(workers == 0){
+            unsigned int hw = std::thread::hardware_concurrency();
+            workers = hw > 1 ? hw - 1 : 1;
+        }
+        for(unsigned int i = 0; i < workers; i++)
+            this->threads.push_back(std::thread(&JobSystem::workerLoop, this));
+    }
+
+    JobSystem(const JobSystem& copy) = delete;
+    JobSystem& operator=(const JobSystem& copy) = delete;
+
+    // the jobs still in the queue are discarded, the ones running are completed
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->jobsMutex);
+            this->stopping = true;
+        }
+        this->jobsCondition.notify_all();
+        for(size_t i = 0; i < this->threads.size(); i++)
+            this->threads[i].join();
+    }
+
+    // the job is executed on one of the worker threads
+    void Submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->jobsMutex);
+            this->jobs.push(job);
+            this->pendingJobs++;
+        }
+        this->jobsCondition.notify_one();
+    }
+
+    // the task is executed on the main thread, during the next call to ProcessMainThread
+    void PostToMainThread(std::function<void()> task)
+    {
+        std::lock_guard<std::mutex> lock(this->tasksMutex);
+        this->tasks.push(task);
+    }
+
+    // it executes the tasks posted to the main thread (at most maxTasks, if >= 0), and it returns the number of executed tasks
+    int ProcessMainThread(int maxTasks = -1)
+    {
+        int executed = 0;
+        while(maxTasks < 0 || executed < maxTasks){
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> lock(this->tasksMutex);
+                if(this->tasks.empty())
+                    break;
+                task = this->tasks.front();
+                this->tasks.pop();
+            }
+            // the task is executed outside the lock, so it can post other tasks
+            task();
+            executed++;
+        }
+        return executed;
+    }
+
+    // true if there are no jobs in the queue or running, and no tasks waiting for the main thread
+    bool Idle()
+    {
+        std::lock_guard<std::mutex> jobsLock(this->jobsMutex);
+        std::lock_guard<std::mutex> tasksLock(this->tasksMutex);
+        return this->pendingJobs == 0 && this->tasks.empty();
+    }
+
+private:
+    vector<std::thread> threads;
+    std::queue<std::function<void()> > jobs;
+    std::mutex jobsMutex;
+    std::condition_variable jobsCondition;
+    bool stopping;
+    // jobs in the queue or running
+    int pendingJobs;
+
+    std::queue<std::function<void()> > tasks;
+    std::mutex tasksMutex;
+
+    void workerLoop()
+    {
+        while(true){
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(this->jobsMutex);
+                this->jobsCondition.wait(lock, [this]{ return this->stopping || !this->jobs.empty(); });
+                if(this->stopping)
+                    return;
+                job = this->jobs.front();
+                this->jobs.pop();
+            }
+            job();
+            std::lock_guard<std::mutex> lock(this->jobsMutex);
+            this->pendingJobs--;
+        }
+    }
+};
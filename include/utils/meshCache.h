@@ -0,0 +1,268 @@
+/*
+Binary mesh cache
+- after the first import of a model with Assimp, the final data of its meshes (vertex and index streams after LOD generation and optimization, bounding box, LODs) are saved in a binary file next to the source model
+- in the following runs, the cache file is memory mapped and its streams are copied as they are in the data of the meshes (MeshData), ready to be uploaded in the OpenGL buffers without any parsing or processing
+
+The cache is valid only if it has been created from the same source file (we compare a hash of its content), with the same Assimp import flags, and with the same version of the format and options of the loader.
+On Windows, the file is read in memory instead of being mapped.
+
+File layout (all the values are little endian, as in memory on x86/ARM):
+    header: magic "RTGPMESH", format version, import flags, source hash, loader options, number of meshes
+    for each mesh:
+        entry: number of vertices, indices, LOD indices and LODs, bounding box
+        Vertex[vertices]            (full precision copy, used on the CPU e.g. by the physics)
+        PackedVertex[vertices]      (the stream uploaded in the VBO)
+        GLuint[indices]
+        GLuint[LOD indices]
+        MeshLOD[LODs]               (without LOD 0, which is the full resolution mesh)
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <utils/mesh_v1.h>
+
+// the version must be incremented every time the layout of the file or of the stored structures changes
+#define MESH_CACHE_VERSION 2
+// the cache file is saved next to the source model, adding this extension
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t importFlags;
+    uint64_t sourceHash;
+    // options of the loader changing the content of the streams (e.g., LODs generation and optimizations)
+    uint32_t options;
+    uint32_t meshCount;
+};
+
+struct MeshCacheEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodIndexCount;
+    uint32_t lodCount;
+    float aabbMin[3];
+    float aabbExtent[3];
+};
+
+//////////////////////////////////////////
+// read-only memory mapping of a file
+class MappedFile
+{
+public:
+    const unsigned char* data;
+    size_t size;
+
+    MappedFile(): data(nullptr), size(0) {}
+    MappedFile(const MappedFile& copy) = delete;
+    MappedFile& operator=(const MappedFile& copy) = delete;
+
+    ~MappedFile()
+    {
+        this->Close();
+    }
+
+    bool Open(const string& path)
+    {
+        this->Close();
+#ifdef _WIN32
+        ifstream file(path.c_str(), ios::binary | ios::ate);
+        if(!file)
+            return false;
+        this->buffer.resize((size_t)file.tellg());
+        file.seekg(0);
+        if(!this->buffer.empty() && !file.read((char*)&this->buffer[0], this->buffer.size()))
+            return false;
+        this->data = this->buffer.empty() ? nullptr : &this->buffer[0];
+        this->size = this->buffer.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return false;
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0){
+            close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping remains valid after closing the file descriptor
+        close(fd);
+        if(p == MAP_FAILED)
+            return false;
+        this->data = (const unsigned char*)p;
+        this->size = (size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void Close()
+    {
+#ifdef _WIN32
+        this->buffer.clear();
+#else
+        if(this->data != nullptr)
+            munmap((void*)this->data, this->size);
+#endif
+        this->data = nullptr;
+        this->size = 0;
+    }
+
+private:
+#ifdef _WIN32
+    vector<unsigned char> buffer;
+#endif
+};
+
+//////////////////////////////////////////
+class MeshCache
+{
+public:
+    // 64 bit FNV-1a hash of the content of the file
+    static bool HashFile(const string& path, uint64_t& hash)
+    {
+        MappedFile file;
+        if(!file.Open(path))
+            return false;
+        hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < file.size; i++){
+            hash ^= file.data[i];
+            hash *= 1099511628211ULL;
+        }
+        return true;
+    }
+
+    // it reads the data of the meshes from the cache file, if it is valid for the given source hash, import flags and options
+    static bool Load(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t options, vector<MeshData>& meshes)
+    {
+        MappedFile file;
+        if(!file.Open(cachePath) || file.size < sizeof(MeshCacheHeader))
+            return false;
+        MeshCacheHeader header;
+        memcpy(&header, file.data, sizeof(header));
+        if(memcmp(header.magic, "RTGPMESH", 8) != 0 || header.version != MESH_CACHE_VERSION ||
+           header.importFlags != importFlags || header.sourceHash != sourceHash || header.options != options)
+            return false;
+
+        // we first validate all the entries, so a truncated file does not leave the model half loaded
+        size_t offset = sizeof(MeshCacheHeader);
+        vector<MeshCacheEntry> entries(header.meshCount);
+        vector<size_t> offsets(header.meshCount);
+        for(uint32_t m = 0; m < header.meshCount; m++){
+            if(offset + sizeof(MeshCacheEntry) > file.size)
+                return false;
+            memcpy(&entries[m], file.data + offset, sizeof(MeshCacheEntry));
+            offset += sizeof(MeshCacheEntry);
+            offsets[m] = offset;
+            offset += streamsSize(entries[m]);
+            if(offset > file.size)
+                return false;
+        }
+
+        meshes.resize(meshes.size() + header.meshCount);
+        for(uint32_t m = 0; m < header.meshCount; m++){
+            const MeshCacheEntry& e = entries[m];
+            const unsigned char* p = file.data + offsets[m];
+            MeshData& d = meshes[meshes.size() - header.meshCount + m];
+            d.vertices.resize(e.vertexCount);
+            d.packedVertices.resize(e.vertexCount);
+            d.indices.resize(e.indexCount);
+            d.lodIndices.resize(e.lodIndexCount);
+            d.lods.resize(e.lodCount);
+            p = readStream(p, d.vertices);
+            p = readStream(p, d.packedVertices);
+            p = readStream(p, d.indices);
+            p = readStream(p, d.lodIndices);
+            p = readStream(p, d.lods);
+            d.aabbMin = glm::vec3(e.aabbMin[0], e.aabbMin[1], e.aabbMin[2]);
+            d.aabbExtent = glm::vec3(e.aabbExtent[0], e.aabbExtent[1], e.aabbExtent[2]);
+        }
+        return true;
+    }
+
+    // it writes the cache file (on a temporary file, renamed at the end, so an interrupted write does not leave an invalid cache)
+    static bool Save(const string& cachePath, uint64_t sourceHash, uint32_t importFlags, uint32_t options, const vector<MeshData>& meshes)
+    {
+        string tmpPath = cachePath + ".tmp";
+        ofstream file(tmpPath.c_str(), ios::binary | ios::trunc);
+        if(!file)
+            return false;
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "RTGPMESH", 8);
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.sourceHash = sourceHash;
+        header.options = options;
+        header.meshCount = (uint32_t)meshes.size();
+        file.write((const char*)&header, sizeof(header));
+
+        for(size_t m = 0; m < meshes.size(); m++){
+            const MeshData& d = meshes[m];
+            MeshCacheEntry e;
+            e.vertexCount = (uint32_t)d.vertices.size();
+            e.indexCount = (uint32_t)d.indices.size();
+            e.lodIndexCount = (uint32_t)d.lodIndices.size();
+            e.lodCount = (uint32_t)d.lods.size();
+            for(int k = 0; k < 3; k++){
+                e.aabbMin[k] = d.aabbMin[k];
+                e.aabbExtent[k] = d.aabbExtent[k];
+            }
+            file.write((const char*)&e, sizeof(e));
+            writeStream(file, d.vertices);
+            // the packed stream is always stored, even if the data have been prepared without it
+            if(d.packedVertices.size() == d.vertices.size())
+                writeStream(file, d.packedVertices);
+            else
+                writeStream(file, Mesh::PackVertices(d.vertices, d.aabbMin, d.aabbExtent));
+            writeStream(file, d.indices);
+            writeStream(file, d.lodIndices);
+            writeStream(file, d.lods);
+        }
+        file.close();
+        if(!file){
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        std::remove(cachePath.c_str());
+        return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+private:
+    static size_t streamsSize(const MeshCacheEntry& e)
+    {
+        return (size_t)e.vertexCount * (sizeof(Vertex) + sizeof(PackedVertex)) +
+               ((size_t)e.indexCount + e.lodIndexCount) * sizeof(GLuint) +
+               (size_t)e.lodCount * sizeof(MeshLOD);
+    }
+
+    template <typename T>
+    static const unsigned char* readStream(const unsigned char* p, vector<T>& v)
+    {
+        if(!v.empty())
+            memcpy(&v[0], p, v.size() * sizeof(T));
+        return p + v.size() * sizeof(T);
+    }
+
+    template <typename T>
+    static void writeStream(ofstream& file, const vector<T>& v)
+    {
+        if(!v.empty())
+            file.write((const char*)&v[0], v.size() * sizeof(T));
+    }
+};
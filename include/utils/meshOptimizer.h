@@ -0,0 +1,267 @@
+/*
+Mesh optimization at loading time
+- vertex cache optimization: triangles are reordered to reuse as much as possible the vertices already transformed by the vertex shader (post-transform cache), using the algorithm by Tom Forsyth ("Linear-Speed Vertex Cache Optimisation", 2006)
+- overdraw optimization (optional): clusters of triangles are sorted to draw first the ones facing outside the mesh, which are more likely to occlude the others (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007)
+- vertex fetch optimization: vertices are reordered following their first use in the index buffer, to improve memory locality
+
+The efficiency of the cache is measured with a FIFO cache simulation:
+ACMR: Average Cache Miss Ratio = transformed vertices / triangles (best case ~0.5, worst case 3)
+ATVR: Average Transformed Vertex Ratio = transformed vertices / vertices (best case 1)
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+// size of the cache considered by the optimization and by the simulation
+#define VERTEX_CACHE_SIZE 32
+// the overdraw optimization is kept only if the ACMR does not get worse than this ratio
+#define OVERDRAW_ACMR_THRESHOLD 1.05f
+
+struct VertexCacheStats {
+    float acmr;
+    float atvr;
+};
+
+class MeshOptimizer
+{
+public:
+    //////////////////////////////////////////
+    // FIFO cache simulation
+    static VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        vector<unsigned int> timestamp(vertexCount, 0);
+        unsigned int time = cacheSize + 1;
+        size_t misses = 0;
+        for(size_t i = 0; i < indexCount; i++){
+            GLuint v = indices[i];
+            // the vertex is in the cache if it has been inserted less than cacheSize misses ago
+            if(time - timestamp[v] > (unsigned int)cacheSize){
+                timestamp[v] = time++;
+                misses++;
+            }
+        }
+        VertexCacheStats s;
+        s.acmr = indexCount ? (float)misses / (indexCount / 3) : 0.0f;
+        s.atvr = vertexCount ? (float)misses / vertexCount : 0.0f;
+        return s;
+    }
+
+    //////////////////////////////////////////
+    // Forsyth's algorithm: at each step, we emit the triangle with the best score, where the score of a triangle is the sum of the scores of its vertices
+    // (higher if the vertex is in the cache, and if it has few remaining triangles)
+    static void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount)
+    {
+        size_t triCount = indexCount / 3;
+        if(triCount == 0)
+            return;
+
+        // triangles using each vertex
+        vector<unsigned int> offsets(vertexCount + 1, 0);
+        for(size_t i = 0; i < indexCount; i++)
+            offsets[indices[i] + 1]++;
+        for(size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] += offsets[v];
+        vector<unsigned int> vertexTris(indexCount);
+        vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+        for(size_t i = 0; i < indexCount; i++)
+            vertexTris[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+        vector<unsigned int> activeTris(vertexCount);
+        for(size_t v = 0; v < vertexCount; v++)
+            activeTris[v] = offsets[v + 1] - offsets[v];
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount);
+        for(size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = scoreVertex(cachePosition[v], activeTris[v]);
+
+        vector<float> triScore(triCount);
+        vector<bool> emitted(triCount, false);
+        for(size_t t = 0; t < triCount; t++)
+            triScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t+1]] + vertexScore[indices[3*t+2]];
+
+        vector<GLuint> output;
+        output.reserve(indexCount);
+        vector<GLuint> cache, newCache;
+        size_t scanCursor = 0;
+
+        int best = (int)(std::max_element(triScore.begin(), triScore.end()) - triScore.begin());
+        while(best >= 0){
+            emitted[best] = true;
+            GLuint tri[3] = { indices[3*best], indices[3*best+1], indices[3*best+2] };
+            output.insert(output.end(), tri, tri + 3);
+
+            // the vertices of the triangle go in front of the cache
+            newCache.assign(tri, tri + 3);
+            for(size_t i = 0; i < cache.size(); i++)
+                if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                    newCache.push_back(cache[i]);
+
+            // the emitted triangle is removed from the lists of its vertices
+            for(int k = 0; k < 3; k++){
+                GLuint v = tri[k];
+                unsigned int* first = &vertexTris[offsets[v]];
+                unsigned int* last = first + activeTris[v];
+                unsigned int* it = std::find(first, last, (unsigned int)best);
+                if(it != last){
+                    std::swap(*it, *(last - 1));
+                    activeTris[v]--;
+                }
+            }
+
+            // we update the scores of the vertices in the cache (and of the ones pushed out of it), and of their triangles
+            for(size_t i = 0; i < newCache.size(); i++){
+                GLuint v = newCache[i];
+                cachePosition[v] = i < VERTEX_CACHE_SIZE ? (int)i : -1;
+            }
+            best = -1;
+            float bestScore = -1.0f;
+            for(size_t i = 0; i < newCache.size(); i++){
+                GLuint v = newCache[i];
+                vertexScore[v] = scoreVertex(cachePosition[v], activeTris[v]);
+            }
+            for(size_t i = 0; i < newCache.size(); i++){
+                GLuint v = newCache[i];
+                for(unsigned int j = 0; j < activeTris[v]; j++){
+                    unsigned int t = vertexTris[offsets[v] + j];
+                    triScore[t] = vertexScore[indices[3*t]] + vertexScore[indices[3*t+1]] + vertexScore[indices[3*t+2]];
+                    if(triScore[t] > bestScore){
+                        bestScore = triScore[t];
+                        best = (int)t;
+                    }
+                }
+            }
+            if(newCache.size() > VERTEX_CACHE_SIZE)
+                newCache.resize(VERTEX_CACHE_SIZE);
+            cache.swap(newCache);
+
+            // no triangle around the cache: we take the next triangle not emitted yet
+            if(best < 0){
+                while(scanCursor < triCount && emitted[scanCursor])
+                    scanCursor++;
+                if(scanCursor < triCount)
+                    best = (int)scanCursor;
+            }
+        }
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    //////////////////////////////////////////
+    // the triangles (already optimized for the vertex cache) are split in clusters where the cache is flushed, and the clusters are sorted from the most "outward" to the most "inward"
+    // the new order is kept only if the ACMR does not get worse than OVERDRAW_ACMR_THRESHOLD
+    static void OptimizeOverdraw(GLuint* indices, size_t indexCount, const vector<glm::vec3>& positions)
+    {
+        size_t triCount = indexCount / 3;
+        if(triCount < 2)
+            return;
+        VertexCacheStats before = AnalyzeVertexCache(indices, indexCount, positions.size());
+
+        // cluster boundaries: the triangles whose 3 vertices are all cache misses
+        vector<size_t> clusterStart;
+        vector<unsigned int> timestamp(positions.size(), 0);
+        unsigned int time = VERTEX_CACHE_SIZE + 1;
+        for(size_t t = 0; t < triCount; t++){
+            int misses = 0;
+            for(int k = 0; k < 3; k++){
+                GLuint v = indices[3*t+k];
+                if(time - timestamp[v] > VERTEX_CACHE_SIZE){
+                    timestamp[v] = time++;
+                    misses++;
+                }
+            }
+            if(t == 0 || misses == 3)
+                clusterStart.push_back(t);
+        }
+        clusterStart.push_back(triCount);
+
+        glm::vec3 meshCenter(0.0f);
+        for(size_t i = 0; i < positions.size(); i++)
+            meshCenter += positions[i];
+        meshCenter /= (float)positions.size();
+
+        // for each cluster, we measure how much its (area weighted) normal points outside the mesh
+        vector<std::pair<float, size_t> > order;
+        for(size_t c = 0; c + 1 < clusterStart.size(); c++){
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for(size_t t = clusterStart[c]; t < clusterStart[c+1]; t++){
+                glm::vec3 a = positions[indices[3*t]], b = positions[indices[3*t+1]], d = positions[indices[3*t+2]];
+                glm::vec3 n = glm::cross(b - a, d - a);
+                float l = glm::length(n);
+                centroid += (a + b + d) / 3.0f * l;
+                normal += n;
+                area += l;
+            }
+            if(area > 0.0f)
+                centroid /= area;
+            float dp = glm::dot(centroid - meshCenter, glm::length(normal) > 0.0f ? glm::normalize(normal) : normal);
+            order.push_back(std::make_pair(-dp, c));
+        }
+        std::stable_sort(order.begin(), order.end());
+
+        vector<GLuint> result;
+        result.reserve(indexCount);
+        for(size_t i = 0; i < order.size(); i++){
+            size_t c = order[i].second;
+            result.insert(result.end(), indices + 3*clusterStart[c], indices + 3*clusterStart[c+1]);
+        }
+        VertexCacheStats after = AnalyzeVertexCache(&result[0], result.size(), positions.size());
+        if(after.acmr <= before.acmr * OVERDRAW_ACMR_THRESHOLD)
+            std::copy(result.begin(), result.end(), indices);
+    }
+
+    //////////////////////////////////////////
+    // vertices are reordered following their first use in the index buffers (the arrays are processed in order)
+    // it returns the remap table (old vertex -> new vertex), and it updates the index buffers
+    template <typename VertexType>
+    static vector<GLuint> OptimizeVertexFetch(vector<VertexType>& vertices, const vector<vector<GLuint>*>& indexBuffers)
+    {
+        const GLuint unused = (GLuint)-1;
+        vector<GLuint> remap(vertices.size(), unused);
+        GLuint next = 0;
+        for(size_t b = 0; b < indexBuffers.size(); b++){
+            vector<GLuint>& ib = *indexBuffers[b];
+            for(size_t i = 0; i < ib.size(); i++){
+                if(remap[ib[i]] == unused)
+                    remap[ib[i]] = next++;
+                ib[i] = remap[ib[i]];
+            }
+        }
+        // vertices not used by any triangle are kept at the end
+        for(size_t v = 0; v < remap.size(); v++)
+            if(remap[v] == unused)
+                remap[v] = next++;
+
+        vector<VertexType> reordered(vertices.size());
+        for(size_t v = 0; v < vertices.size(); v++)
+            reordered[remap[v]] = vertices[v];
+        vertices.swap(reordered);
+        return remap;
+    }
+
+private:
+    static float scoreVertex(int cachePosition, unsigned int activeTris)
+    {
+        // no more triangles use this vertex
+        if(activeTris == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if(cachePosition >= 0){
+            // the vertices of the last triangle have a fixed score, to avoid to favour triangles using the same 2 vertices
+            if(cachePosition < 3)
+                score = 0.75f;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (VERTEX_CACHE_SIZE - 3), 1.5f);
+        }
+        // bonus for vertices with few remaining triangles, to avoid leaving isolated triangles
+        score += 2.0f * std::pow((float)activeTris, -0.5f);
+        return score;
+    }
+};
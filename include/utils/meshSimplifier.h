@@ -0,0 +1,280 @@
+/*
+Mesh simplification with Quadric Error Metrics
+- it generates the index buffers of coarser Levels of Detail of a mesh, using edge collapses ordered by the quadric error (Garland & Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997)
+
+We use half-edge collapses (a vertex is moved onto one of its neighbours), so all the LODs share the same vertex buffer of the original mesh, and only a new index buffer is needed for each level.
+Vertices on the borders of the mesh are never collapsed, and collapses flipping a triangle are rejected.
+Vertices with the same position (e.g., on UV or normal seams) are welded during the simplification.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <queue>
+#include <map>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+// a level of detail is a range of the index buffer of the mesh
+struct MeshLOD {
+    // offset and number of indices in the index buffer
+    GLuint indexOffset;
+    GLuint indexCount;
+    // maximum geometric error introduced by the simplification (in model units)
+    float error;
+};
+
+class MeshSimplifier
+{
+public:
+    //////////////////////////////////////////
+    // it simplifies the mesh, producing a LOD for each target ratio of triangles (in decreasing order, e.g. 0.5, 0.25, 0.125)
+    // the indices of the new LODs are appended to lodIndices, and their description to lods
+    static void GenerateLODs(const vector<glm::vec3>& positions, const vector<GLuint>& indices, const vector<float>& ratios,
+                             vector<GLuint>& lodIndices, vector<MeshLOD>& lods, GLuint baseOffset)
+    {
+        MeshSimplifier s(positions, indices);
+        for(size_t r = 0; r < ratios.size(); r++){
+            size_t target = (size_t)(ratios[r] * (indices.size() / 3));
+            s.simplify(target);
+            vector<GLuint> out;
+            s.collect(out);
+            // if the simplification is stuck, there is no reason to keep a LOD equal to the previous one
+            GLuint previousCount = lods.empty() ? (GLuint)indices.size() : lods.back().indexCount;
+            if(out.empty() || out.size() >= previousCount)
+                break;
+            MeshLOD lod;
+            lod.indexOffset = baseOffset + (GLuint)lodIndices.size();
+            lod.indexCount = (GLuint)out.size();
+            lod.error = (float)std::sqrt(s.maxError);
+            lods.push_back(lod);
+            lodIndices.insert(lodIndices.end(), out.begin(), out.end());
+        }
+    }
+
+private:
+    // symmetric 4x4 matrix, we store only the upper triangle, and the sum of the weights of the planes
+    struct Quadric {
+        double a[10];
+        double weight;
+        Quadric(): weight(0.0) { for(int i = 0; i < 10; i++) a[i] = 0.0; }
+        // quadric of the plane ax+by+cz+d=0, weighted by w
+        Quadric(double pa, double pb, double pc, double pd, double w): weight(w) {
+            a[0] = w*pa*pa; a[1] = w*pa*pb; a[2] = w*pa*pc; a[3] = w*pa*pd;
+            a[4] = w*pb*pb; a[5] = w*pb*pc; a[6] = w*pb*pd;
+            a[7] = w*pc*pc; a[8] = w*pc*pd;
+            a[9] = w*pd*pd;
+        }
+        void add(const Quadric& q) { for(int i = 0; i < 10; i++) a[i] += q.a[i]; weight += q.weight; }
+        // v^T Q v, with v = (x,y,z,1)
+        double eval(const glm::vec3& v) const {
+            double x = v.x, y = v.y, z = v.z;
+            return a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x
+                 + a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y
+                 + a[7]*z*z + 2*a[8]*z
+                 + a[9];
+        }
+        // weighted mean of the squared distances from the planes (a squared length, independent of the weights)
+        double meanSquaredDistance(const glm::vec3& v) const {
+            return weight > 0.0 ? std::max(eval(v), 0.0) / weight : 0.0;
+        }
+    };
+
+    // candidate collapse of vertex "from" onto vertex "to"
+    // the collapses are ordered by the area weighted cost, while the geometric error is the mean squared distance from the planes
+    struct Collapse {
+        double cost;
+        double error;
+        int from, to;
+        unsigned int versionFrom, versionTo;
+        bool operator<(const Collapse& c) const { return cost > c.cost; } // min-heap
+    };
+
+    // welded positions, and for each of them the first original vertex with that position
+    vector<glm::vec3> pos;
+    vector<GLuint> representative;
+    // for each original vertex, the welded vertex
+    vector<int> weld;
+    // triangles on welded vertices, and the original vertices of their corners
+    vector<int> tris;
+    vector<GLuint> corners;
+    vector<bool> triRemoved;
+    size_t triCount;
+    // triangles around each welded vertex (it may contain removed triangles)
+    vector<vector<int> > adjacency;
+    vector<Quadric> quadrics;
+    vector<int> collapsedInto;
+    vector<bool> locked;
+    vector<unsigned int> version;
+    std::priority_queue<Collapse> heap;
+    double maxError;
+
+    MeshSimplifier(const vector<glm::vec3>& positions, const vector<GLuint>& indices): triCount(0), maxError(0.0)
+    {
+        // we weld the vertices with the same position
+        std::map<std::pair<float, std::pair<float, float> >, int> unique;
+        weld.resize(positions.size());
+        for(size_t i = 0; i < positions.size(); i++){
+            std::pair<float, std::pair<float, float> > k(positions[i].x, std::make_pair(positions[i].y, positions[i].z));
+            std::map<std::pair<float, std::pair<float, float> >, int>::iterator it = unique.find(k);
+            if(it == unique.end()){
+                int id = (int)pos.size();
+                unique[k] = id;
+                pos.push_back(positions[i]);
+                representative.push_back((GLuint)i);
+                weld[i] = id;
+            }
+            else
+                weld[i] = it->second;
+        }
+
+        size_t n = pos.size();
+        adjacency.resize(n);
+        quadrics.resize(n);
+        collapsedInto.resize(n);
+        locked.assign(n, false);
+        version.assign(n, 0);
+        for(size_t i = 0; i < n; i++)
+            collapsedInto[i] = (int)i;
+
+        for(size_t i = 0; i + 2 < indices.size(); i += 3){
+            int a = weld[indices[i]], b = weld[indices[i+1]], c = weld[indices[i+2]];
+            if(a == b || b == c || a == c)
+                continue;
+            int t = (int)(tris.size() / 3);
+            tris.push_back(a); tris.push_back(b); tris.push_back(c);
+            corners.push_back(indices[i]); corners.push_back(indices[i+1]); corners.push_back(indices[i+2]);
+            adjacency[a].push_back(t); adjacency[b].push_back(t); adjacency[c].push_back(t);
+            // plane quadric, weighted by the area of the triangle
+            glm::vec3 nrm = glm::cross(pos[b] - pos[a], pos[c] - pos[a]);
+            double area = glm::length(nrm);
+            if(area > 0.0){
+                glm::vec3 u = nrm / (float)area;
+                Quadric q(u.x, u.y, u.z, -glm::dot(u, pos[a]), area * 0.5);
+                quadrics[a].add(q); quadrics[b].add(q); quadrics[c].add(q);
+            }
+        }
+        triCount = tris.size() / 3;
+        triRemoved.assign(triCount, false);
+
+        // an edge used by a single triangle is on the border: its vertices are locked
+        std::map<std::pair<int, int>, int> edges;
+        for(size_t t = 0; t < triCount; t++)
+            for(int e = 0; e < 3; e++){
+                int v0 = tris[3*t+e], v1 = tris[3*t+(e+1)%3];
+                edges[std::make_pair(std::min(v0, v1), std::max(v0, v1))]++;
+            }
+        for(std::map<std::pair<int, int>, int>::iterator it = edges.begin(); it != edges.end(); ++it)
+            if(it->second == 1){
+                locked[it->first.first] = true;
+                locked[it->first.second] = true;
+            }
+
+        for(size_t t = 0; t < triCount; t++)
+            for(int e = 0; e < 3; e++)
+                pushCollapses(tris[3*t+e], tris[3*t+(e+1)%3]);
+    }
+
+    void pushCollapses(int a, int b)
+    {
+        Quadric q = quadrics[a];
+        q.add(quadrics[b]);
+        if(!locked[a]){
+            Collapse c = { q.eval(pos[b]), q.meanSquaredDistance(pos[b]), a, b, version[a], version[b] };
+            heap.push(c);
+        }
+        if(!locked[b]){
+            Collapse c = { q.eval(pos[a]), q.meanSquaredDistance(pos[a]), b, a, version[b], version[a] };
+            heap.push(c);
+        }
+    }
+
+    // the collapse is rejected if it flips (or makes too thin) a triangle around "from"
+    bool isValid(int from, int to)
+    {
+        for(size_t i = 0; i < adjacency[from].size(); i++){
+            int t = adjacency[from][i];
+            if(triRemoved[t])
+                continue;
+            int* v = &tris[3*t];
+            if(v[0] == to || v[1] == to || v[2] == to)
+                continue;
+            glm::vec3 p[3], q[3];
+            for(int k = 0; k < 3; k++){
+                p[k] = pos[v[k]];
+                q[k] = (v[k] == from) ? pos[to] : pos[v[k]];
+            }
+            glm::vec3 n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+            glm::vec3 n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+            float l0 = glm::length(n0), l1 = glm::length(n1);
+            if(l1 <= 0.0f || l0 <= 0.0f || glm::dot(n0, n1) < 0.2f * l0 * l1)
+                return false;
+        }
+        return true;
+    }
+
+    void simplify(size_t targetTriangles)
+    {
+        while(triCount > targetTriangles && !heap.empty()){
+            Collapse c = heap.top();
+            heap.pop();
+            // outdated candidate: one of the vertices has been collapsed or modified
+            if(collapsedInto[c.from] != c.from || collapsedInto[c.to] != c.to)
+                continue;
+            if(c.versionFrom != version[c.from] || c.versionTo != version[c.to])
+                continue;
+            if(!isValid(c.from, c.to))
+                continue;
+
+            // we move all the triangles of "from" to "to", removing the ones containing the collapsed edge
+            for(size_t i = 0; i < adjacency[c.from].size(); i++){
+                int t = adjacency[c.from][i];
+                if(triRemoved[t])
+                    continue;
+                int* v = &tris[3*t];
+                if(v[0] == c.to || v[1] == c.to || v[2] == c.to){
+                    triRemoved[t] = true;
+                    triCount--;
+                    continue;
+                }
+                for(int k = 0; k < 3; k++)
+                    if(v[k] == c.from){
+                        v[k] = c.to;
+                        corners[3*t+k] = representative[c.to];
+                    }
+                adjacency[c.to].push_back(t);
+            }
+            adjacency[c.from].clear();
+            collapsedInto[c.from] = c.to;
+            quadrics[c.to].add(quadrics[c.from]);
+            maxError = std::max(maxError, c.error);
+
+            // the quadric of "to" has changed: the old candidates using it are outdated, and we add the new ones
+            version[c.to]++;
+            for(size_t i = 0; i < adjacency[c.to].size(); i++){
+                int t = adjacency[c.to][i];
+                if(triRemoved[t])
+                    continue;
+                for(int k = 0; k < 3; k++)
+                    if(tris[3*t+k] != c.to)
+                        pushCollapses(c.to, tris[3*t+k]);
+            }
+        }
+    }
+
+    // it writes the remaining triangles, using the original vertices
+    // (the corners never moved keep their original vertex, so the seams are preserved where possible)
+    void collect(vector<GLuint>& out)
+    {
+        for(size_t t = 0; t < triRemoved.size(); t++){
+            if(triRemoved[t])
+                continue;
+            for(int k = 0; k < 3; k++)
+                out.push_back(corners[3*t+k]);
+        }
+    }
+};
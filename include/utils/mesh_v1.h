@@ -31,6 +31,20 @@ using namespace std;
 // Std. Includes
 #include <vector>
 
+// Levels of Detail generation
+#include <utils/meshSimplifier.h>
+
+// maximum error (in pixels) accepted when choosing a simplified LOD
+#define LOD_PIXEL_ERROR 1.0f
+
+// conversion to half floats and normalized integers
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// if true, the vertices are uploaded to the GPU using the compact PackedVertex format (20 bytes instead of the 56 bytes of Vertex)
+// the CPU copy of the vertices (used e.g. by the physics) is always kept in the Vertex format
+#define PACKED_VERTEX_FORMAT true
+
 // data structure for vertices
 struct Vertex {
     // vertex coordinates
@@ -45,14 +59,47 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// compact data structure for vertices, used for the VBO
+struct PackedVertex {
+    // vertex coordinates, quantized to 16 bits inside the bounding box of the mesh
+    // the 4th component stores the sign of the bitangent (0 -> -1, 65535 -> +1)
+    GLushort Position[4];
+    // Normal, with octahedral encoding (2 x 16 bits signed normalized)
+    GLshort Normal[2];
+    // Texture coordinates, as half floats
+    GLushort TexCoords[2];
+    // Tangent, with octahedral encoding. The Bitangent is reconstructed as cross(Normal, Tangent) * sign
+    GLshort Tangent[2];
+};
+
+// CPU side data of a mesh, produced by the loading (also on a worker thread, see Model::Import) and moved in a Mesh instance, which creates the GPU buffers
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<GLuint> indices;
+    // indices and description of the simplified LODs (LOD 0 excluded)
+    vector<GLuint> lodIndices;
+    vector<MeshLOD> lods;
+    // bounding box, and vertices converted in the PackedVertex format (see Mesh::Prepare)
+    glm::vec3 aabbMin, aabbExtent;
+    vector<PackedVertex> packedVertices;
+    // report of the LODs and of the vertex cache optimization: the meshes are processed on worker threads, so it is printed by Model::Upload on the main thread (empty for the meshes read from the cache)
+    string report;
+};
+
 /////////////////// MESH class ///////////////////////
 class Mesh {
 public:
     // data structures for vertices, and indices of vertices (for faces)
     vector<Vertex> vertices;
     vector<GLuint> indices;
+    // indices of the simplified LODs, stored in the EBO after the ones of the full resolution mesh
+    vector<GLuint> lodIndices;
+    // Levels of Detail (LOD 0 is the full resolution mesh)
+    vector<MeshLOD> lods;
     // VAO
     GLuint VAO;
+    // bounding box of the mesh, used to dequantize the positions of the packed vertices
+    glm::vec3 aabbMin, aabbExtent;
 
     // We want Mesh to be a move-only class. We delete copy constructor and copy assignment
     // see:
@@ -70,9 +117,33 @@ public:
     Mesh(vector<Vertex>& vertices, vector<GLuint>& indices) noexcept
         : vertices(std::move(vertices)), indices(std::move(indices))
     {
+        this->setupLODs();
         this->setupMesh();
     }
 
+    // Constructor with the simplified LODs (see MeshSimplifier)
+    // The offsets of the LODs must consider that their indices are placed after the ones of the full resolution mesh
+    Mesh(vector<Vertex>& vertices, vector<GLuint>& indices, vector<GLuint>& lodIndices, vector<MeshLOD>& lods) noexcept
+        : vertices(std::move(vertices)), indices(std::move(indices)), lodIndices(std::move(lodIndices))
+    {
+        this->setupLODs();
+        this->lods.insert(this->lods.end(), lods.begin(), lods.end());
+        this->setupMesh();
+    }
+
+    // Constructor from the data prepared on the CPU (e.g., read from the binary mesh cache, see meshCache.h)
+    // if already computed, the packed vertices are uploaded as they are in the VBO
+    // This constructor empties the vectors of the source data
+    Mesh(MeshData& data) noexcept
+        : vertices(std::move(data.vertices)), indices(std::move(data.indices)), lodIndices(std::move(data.lodIndices)),
+        aabbMin(data.aabbMin), aabbExtent(data.aabbExtent)
+    {
+        this->setupLODs();
+        this->lods.insert(this->lods.end(), data.lods.begin(), data.lods.end());
+        this->setupMesh(data.packedVertices.empty() ? nullptr : &data.packedVertices[0]);
+        data.packedVertices.clear();
+    }
+
     // We implement a user-defined move constructor and move assignment
     // see:
     // https://docs.microsoft.com/en-us/cpp/cpp/move-constructors-and-move-assignment-operators-cpp?view=vs-2019
@@ -88,7 +159,8 @@ public:
     Mesh(Mesh&& move) noexcept
         // Calls move for both vectors, which internally consists of a simple pointer swap between the new instance and the source one.
         : vertices(std::move(move.vertices)), indices(std::move(move.indices)),
-        VAO(move.VAO), VBO(move.VBO), EBO(move.EBO)
+        lodIndices(std::move(move.lodIndices)), lods(std::move(move.lods)),
+        VAO(move.VAO), aabbMin(move.aabbMin), aabbExtent(move.aabbExtent), VBO(move.VBO), EBO(move.EBO)
     {
         move.VAO = 0; // We *could* set VBO and EBO to 0 too,
         // but since we bring all the 3 values around we can use just one of them to check ownership of the 3 resources.
@@ -104,7 +176,11 @@ public:
         {
             vertices = std::move(move.vertices);
             indices = std::move(move.indices);
+            lodIndices = std::move(move.lodIndices);
+            lods = std::move(move.lods);
             VAO = move.VAO;
+            aabbMin = move.aabbMin;
+            aabbExtent = move.aabbExtent;
             VBO = move.VBO;
             EBO = move.EBO;
 
@@ -127,16 +203,97 @@ public:
     //////////////////////////////////////////
 
     // rendering of mesh
-    void Draw()
+    void Draw(int lod = 0)
     {
         // VAO is made "active"
         glBindVertexArray(this->VAO);
         // rendering of data in the VAO
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
+        this->DrawBound(lod);
         // VAO is "detached"
         glBindVertexArray(0);
     }
 
+    // rendering of mesh, assuming that its VAO has already been made "active" by the caller
+    // (used by the render queue, which binds each VAO only once for all the draws sharing it)
+    void DrawBound(int lod = 0)
+    {
+        const MeshLOD &l = this->lods[lod];
+        glDrawElements(GL_TRIANGLES, l.indexCount, GL_UNSIGNED_INT, (GLvoid*)(l.indexOffset * sizeof(GLuint)));
+    }
+
+    //////////////////////////////////////////
+    // it sets, in the active Shader Program, the uniforms needed by the vertex shader to decode the vertex format
+    void SetDecodeUniforms(GLuint program)
+    {
+        glUniform1i(glGetUniformLocation(program, "packedVertices"), PACKED_VERTEX_FORMAT);
+        glm::vec3 scale = PACKED_VERTEX_FORMAT ? this->aabbExtent : glm::vec3(1.0f);
+        glm::vec3 offset = PACKED_VERTEX_FORMAT ? this->aabbMin : glm::vec3(0.0f);
+        glUniform3fv(glGetUniformLocation(program, "positionScale"), 1, glm::value_ptr(scale));
+        glUniform3fv(glGetUniformLocation(program, "positionOffset"), 1, glm::value_ptr(offset));
+    }
+
+    //////////////////////////////////////////
+    // it computes bounding box and packed vertices of the data, so they can be prepared on a worker thread before creating the Mesh
+    static void Prepare(MeshData& data)
+    {
+        ComputeBounds(data.vertices, data.aabbMin, data.aabbExtent);
+        if(PACKED_VERTEX_FORMAT)
+            data.packedVertices = PackVertices(data.vertices, data.aabbMin, data.aabbExtent);
+    }
+
+    // bounding box of the vertices (a flat dimension is extended to avoid a division by 0 in the quantization)
+    static void ComputeBounds(const vector<Vertex>& vertices, glm::vec3& aabbMin, glm::vec3& aabbExtent)
+    {
+        glm::vec3 minP(0.0f), maxP(0.0f);
+        if(!vertices.empty())
+            minP = maxP = vertices[0].Position;
+        for(GLuint i = 1; i < vertices.size(); i++)
+        {
+            minP = glm::min(minP, vertices[i].Position);
+            maxP = glm::max(maxP, vertices[i].Position);
+        }
+        aabbMin = minP;
+        aabbExtent = glm::max(maxP - minP, glm::vec3(1e-6f));
+    }
+
+    // conversion of the vertices in the PackedVertex format, using the bounding box of the mesh
+    static vector<PackedVertex> PackVertices(const vector<Vertex>& vertices, glm::vec3 aabbMin, glm::vec3 aabbExtent)
+    {
+        vector<PackedVertex> packed(vertices.size());
+        for(GLuint i = 0; i < vertices.size(); i++)
+        {
+            const Vertex &v = vertices[i];
+            PackedVertex &p = packed[i];
+            glm::vec3 q = (v.Position - aabbMin) / aabbExtent;
+            p.Position[0] = glm::packUnorm1x16(q.x);
+            p.Position[1] = glm::packUnorm1x16(q.y);
+            p.Position[2] = glm::packUnorm1x16(q.z);
+            // handedness of the tangent frame
+            bool rightHanded = glm::dot(glm::cross(v.Normal, v.Tangent), v.Bitangent) >= 0.0f;
+            p.Position[3] = rightHanded ? 65535 : 0;
+            glm::vec2 n = octEncode(v.Normal);
+            p.Normal[0] = (GLshort)glm::packSnorm1x16(n.x);
+            p.Normal[1] = (GLshort)glm::packSnorm1x16(n.y);
+            glm::vec2 t = octEncode(v.Tangent);
+            p.Tangent[0] = (GLshort)glm::packSnorm1x16(t.x);
+            p.Tangent[1] = (GLshort)glm::packSnorm1x16(t.y);
+            p.TexCoords[0] = glm::packHalf1x16(v.TexCoords.x);
+            p.TexCoords[1] = glm::packHalf1x16(v.TexCoords.y);
+        }
+        return packed;
+    }
+
+    //////////////////////////////////////////
+    // it chooses the coarsest LOD whose error, projected on the screen, is below LOD_PIXEL_ERROR
+    // pixelsPerUnit is the size on screen (in pixels) of a unit of the model space at the distance of the instance
+    int SelectLOD(float pixelsPerUnit)
+    {
+        for(int i = (int)this->lods.size() - 1; i > 0; i--)
+            if(this->lods[i].error * pixelsPerUnit <= LOD_PIXEL_ERROR)
+                return i;
+        return 0;
+    }
+
 private:
 
     // VBO and EBO
@@ -148,7 +305,8 @@ private:
     // https://learnopengl.com/#!Getting-started/Hello-Triangle
     // (in different parts of the page), or here:
     // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
-    void setupMesh()
+    // if packedVertices is not null, it is uploaded without computing again bounding box and quantization
+    void setupMesh(const PackedVertex* packedVertices = nullptr)
     {
         // we create the buffers
         glGenVertexArrays(1, &this->VAO);
@@ -159,32 +317,95 @@ private:
         glBindVertexArray(this->VAO);
         // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
         glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-        glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+        if(PACKED_VERTEX_FORMAT && packedVertices != nullptr)
+            glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(PackedVertex), packedVertices, GL_STATIC_DRAW);
+        else if(PACKED_VERTEX_FORMAT)
+        {
+            ComputeBounds(this->vertices, this->aabbMin, this->aabbExtent);
+            vector<PackedVertex> packed = PackVertices(this->vertices, this->aabbMin, this->aabbExtent);
+            glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), &packed[0], GL_STATIC_DRAW);
+        }
+        else
+        {
+            ComputeBounds(this->vertices, this->aabbMin, this->aabbExtent);
+            glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+        }
         // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
+        // the indices of the simplified LODs are placed after the ones of the full resolution mesh
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (this->indices.size() + this->lodIndices.size()) * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, this->indices.size() * sizeof(GLuint), &this->indices[0]);
+        if(!this->lodIndices.empty())
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->lodIndices.size() * sizeof(GLuint), &this->lodIndices[0]);
 
         // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
         // vertex positions
         // these will be the positions to use in the layout qualifiers in the shaders ("layout (location = ...)"")
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-        // Normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-        // Texture Coordinates
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-        // Tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
-        // Bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
+        if(PACKED_VERTEX_FORMAT)
+        {
+            // normalized integers are converted to floats in [0,1] (unsigned) or [-1,1] (signed), and then decoded in the vertex shader
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+            // Normals
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+            // Texture Coordinates
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+            // Tangent (the Bitangent is reconstructed in the shader)
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Tangent));
+        }
+        else
+        {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+            // Normals
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+            // Texture Coordinates
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+            // Tangent
+            glEnableVertexAttribArray(3);
+            glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Tangent));
+            // Bitangent
+            glEnableVertexAttribArray(4);
+            glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
+        }
 
         glBindVertexArray(0);
     }
 
+    // octahedral encoding of a unit vector: the vector is projected on the octahedron |x|+|y|+|z|=1, and the lower half is folded on the upper one
+    // see Cigolle et al., "A Survey of Efficient Representations for Independent Unit Vectors", JCGT 2014
+    static glm::vec2 octEncode(glm::vec3 n)
+    {
+        float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+        if(l1 == 0.0f)
+            return glm::vec2(0.0f);
+        n /= l1;
+        glm::vec2 e(n.x, n.y);
+        if(n.z < 0.0f)
+        {
+            e.x = (1.0f - std::abs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+            e.y = (1.0f - std::abs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return e;
+    }
+
+    //////////////////////////////////////////
+    // LOD 0 is always the full resolution mesh
+    void setupLODs()
+    {
+        MeshLOD full;
+        full.indexOffset = 0;
+        full.indexCount = (GLuint)this->indices.size();
+        full.error = 0.0f;
+        this->lods.clear();
+        this->lods.push_back(full);
+    }
+
     //////////////////////////////////////////
 
     void freeGPUresources()
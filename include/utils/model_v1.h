@@ -34,6 +34,23 @@ using namespace std;
 // we include the Mesh class, which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
 #include <utils/mesh_v1.h>
 
+// optimization of the index and vertex buffers
+#include <utils/meshOptimizer.h>
+
+// binary cache of the imported meshes
+#include <utils/meshCache.h>
+#include <chrono>
+#include <sstream>
+
+// meshes with less triangles than this are not simplified
+#define LOD_MIN_TRIANGLES 128
+// if true, the triangles are also reordered to reduce overdraw (see MeshOptimizer::OptimizeOverdraw)
+#define OPTIMIZE_OVERDRAW true
+// post-processing operations performed by Assimp after the loading (they are part of the key of the mesh cache)
+#define MODEL_IMPORT_FLAGS (aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace)
+// if true, the imported meshes are saved in a binary cache, and loaded from it in the following runs (see meshCache.h)
+#define USE_MESH_CACHE true
+
 /////////////////// MODEL class ///////////////////////
 class Model
 {
@@ -70,7 +87,47 @@ public:
     // because we are not writing a user-defined destructor.
     Model(const string& path)
     {
-        this->loadModel(path);
+        vector<MeshData> data = Import(path);
+        this->Upload(data);
+    }
+
+    // empty model, used as a placeholder while its data are loaded asynchronously (see Import and Upload)
+    Model() {}
+
+    //////////////////////////////////////////
+    // loading of the model on the CPU: it does not use OpenGL, so it can be executed on a worker thread (see jobSystem.h)
+    // the model is read from the binary mesh cache if valid, otherwise it is imported with Assimp and the cache is written
+    static vector<MeshData> Import(const string& path)
+    {
+        vector<MeshData> data;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        string cachePath = path + MESH_CACHE_EXTENSION;
+        uint64_t sourceHash = 0;
+        bool hashed = USE_MESH_CACHE && MeshCache::HashFile(path, sourceHash);
+        if(hashed && MeshCache::Load(cachePath, sourceHash, MODEL_IMPORT_FLAGS, loaderOptions(), data))
+        {
+            cout << "Model " << path << " loaded from the mesh cache in " << elapsedMs(start) << " ms" << endl;
+            return data;
+        }
+
+        if(!loadModel(path, data))
+            return data;
+        cout << "Model " << path << " imported in " << elapsedMs(start) << " ms" << endl;
+
+        if(hashed && !MeshCache::Save(cachePath, sourceHash, MODEL_IMPORT_FLAGS, loaderOptions(), data))
+            cout << "WARNING::MESH_CACHE:: unable to write " << cachePath << endl;
+        return data;
+    }
+
+    // creation of the GPU buffers of the meshes: it must be executed on the thread owning the OpenGL context
+    // the data are moved in the meshes
+    void Upload(vector<MeshData>& data)
+    {
+        for(GLuint i = 0; i < data.size(); i++)
+        {
+            cout << data[i].report;
+            this->meshes.emplace_back(Mesh(data[i]));
+        }
     }
 
     //////////////////////////////////////////
@@ -88,8 +145,8 @@ public:
 private:
 
     //////////////////////////////////////////
-    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
-    void loadModel(string path)
+    // loading of the model using Assimp library. Nodes are processed to build a vector of MeshData, used to create the Mesh class instances
+    static bool loadModel(const string& path, vector<MeshData>& data)
     {
         // loading using Assimp
         // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
@@ -97,23 +154,35 @@ private:
         // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
         // If they are not present, the calculation is skipped (but no error is provided in the following checks!)
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, MODEL_IMPORT_FLAGS);
 
         // check for errors (see comment above)
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
 
         // we start the recursive processing of nodes in the Assimp data structure
-        this->processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, data);
+        return true;
+    }
+
+    // the options of the processing of the meshes, used to invalidate the cache when they change
+    static uint32_t loaderOptions()
+    {
+        return (uint32_t)LOD_MIN_TRIANGLES | ((uint32_t)OPTIMIZE_OVERDRAW << 16) | ((uint32_t)PACKED_VERTEX_FORMAT << 17);
+    }
+
+    static double elapsedMs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
     }
 
     //////////////////////////////////////////
 
     // Recursive processing of nodes of Assimp data structure
-    void processNode(aiNode* node, const aiScene* scene)
+    static void processNode(aiNode* node, const aiScene* scene, vector<MeshData>& data)
     {
         // we process each mesh inside the current node
         for(GLuint i = 0; i < node->mNumMeshes; i++)
@@ -122,25 +191,23 @@ private:
             // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             // we start processing of the Assimp mesh using processMesh method.
-            // the result (an istance of the Mesh class) is added to the vector
-            // we use emplace_back instead as push_back, so to have the instance created directly in the 
-            // vector memory, without the creation of a temp copy.
-            // https://en.cppreference.com/w/cpp/container/vector/emplace_back 
-            this->meshes.emplace_back(processMesh(mesh));
+            // the result (the data used to create an istance of the Mesh class) is added to the vector
+            data.push_back(MeshData());
+            processMesh(mesh, data.back());
         }
         // we then recursively process each of the children nodes
         for(GLuint i = 0; i < node->mNumChildren; i++)
         {
-            this->processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, data);
         }
 
     }
 
     //////////////////////////////////////////
 
-    // Processing of the Assimp mesh in order to obtain an "OpenGL mesh"
-    // = we create and allocate the buffers used to send mesh data to the GPU
-    Mesh processMesh(aiMesh* mesh)
+    // Processing of the Assimp mesh in order to obtain the data of an "OpenGL mesh"
+    // = we prepare the data used to create and allocate the buffers used to send mesh data to the GPU
+    static void processMesh(aiMesh* mesh, MeshData& data)
     {
         // data structures for vertices and indices of vertices (for faces)
         vector<Vertex> vertices;
@@ -186,6 +253,8 @@ private:
             }
             else{
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+                vertex.Tangent = glm::vec3(0.0f, 0.0f, 0.0f);
+                vertex.Bitangent = glm::vec3(0.0f, 0.0f, 0.0f);
                 cout << "WARNING::ASSIMP:: MODEL WITHOUT UV COORDINATES -> TANGENT AND BITANGENT ARE = 0" << endl;
             }
             // we add the vertex to the list
@@ -200,7 +269,62 @@ private:
                 indices.push_back(face.mIndices[j]);
         }
 
-        // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices);
+        // we generate the simplified Levels of Detail (50%, 25% and 12.5% of the triangles)
+        vector<GLuint> lodIndices;
+        vector<MeshLOD> lods;
+        ostringstream report;
+        if(indices.size() / 3 >= LOD_MIN_TRIANGLES)
+        {
+            vector<glm::vec3> positions;
+            for(GLuint i = 0; i < vertices.size(); i++)
+                positions.push_back(vertices[i].Position);
+            vector<float> ratios = {0.5f, 0.25f, 0.125f};
+            MeshSimplifier::GenerateLODs(positions, indices, ratios, lodIndices, lods, (GLuint)indices.size());
+
+            // we write a report comparing triangle counts and error of the LODs
+            report << "LOD 0: " << indices.size() / 3 << " triangles" << endl;
+            for(GLuint i = 0; i < lods.size(); i++)
+                report << "LOD " << i + 1 << ": " << lods[i].indexCount / 3 << " triangles ("
+                     << 100.0f * lods[i].indexCount / indices.size() << "%), error " << lods[i].error << endl;
+        }
+
+        // we reorder triangles and vertices of all the LODs to improve the efficiency of the post-transform vertex cache and of the vertex fetch
+        optimizeMesh(vertices, indices, lodIndices, lods, report);
+
+        // we fill the data used to create the instance of the Mesh class, with the vertices and faces data structures we have created above.
+        data.vertices.swap(vertices);
+        data.indices.swap(indices);
+        data.lodIndices.swap(lodIndices);
+        data.lods.swap(lods);
+        data.report = report.str();
+        Mesh::Prepare(data);
+    }
+
+    //////////////////////////////////////////
+
+    // Optimization of the buffers, computed once at loading time (see meshOptimizer.h)
+    static void optimizeMesh(vector<Vertex>& vertices, vector<GLuint>& indices, vector<GLuint>& lodIndices, vector<MeshLOD>& lods, ostringstream& report)
+    {
+        if(indices.empty())
+            return;
+        VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(&indices[0], indices.size(), vertices.size());
+
+        MeshOptimizer::OptimizeVertexCache(&indices[0], indices.size(), vertices.size());
+        if(OPTIMIZE_OVERDRAW)
+        {
+            vector<glm::vec3> positions;
+            for(GLuint i = 0; i < vertices.size(); i++)
+                positions.push_back(vertices[i].Position);
+            MeshOptimizer::OptimizeOverdraw(&indices[0], indices.size(), positions);
+        }
+        // the LODs are stored in lodIndices, after the indices of the full resolution mesh
+        for(GLuint i = 0; i < lods.size(); i++)
+            MeshOptimizer::OptimizeVertexCache(&lodIndices[lods[i].indexOffset - indices.size()], lods[i].indexCount, vertices.size());
+
+        vector<vector<GLuint>*> indexBuffers = {&indices, &lodIndices};
+        MeshOptimizer::OptimizeVertexFetch(vertices, indexBuffers);
+
+        VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(&indices[0], indices.size(), vertices.size());
+        report << "Vertex cache: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << endl;
     }
 };
@@ -0,0 +1,311 @@
+/*
+NoiseBaker class
+- 3D simplex noise: a C++ port of the GLSL implementation used in the shaders (Ashima Arts, https://github.com/stegu/webgl-noise/, MIT License)
+- bake of a tileable version of the noise (z = 0) in a 2D array texture: the layer k contains the sum of the first k + 1 octaves (fBm), so the shaders read all the octaves with a single lookup
+
+The noise is made tileable blending 4 copies of it shifted by the period P (x and y in [0, P)):
+T(x, y) = [n(x, y) (P - x) (P - y) + n(x - P, y) x (P - y) + n(x, y - P) (P - x) y + n(x - P, y - P) x y] / P^2
+so T(P, y) = T(0, y) and T(x, P) = T(x, 0). Octave i is T(2^i x mod P), which has period P too: its values at the texels are read from the bake of the first octave
+(at the texel 2^i x, so the value is snapped to the center of that texel).
+
+The noise is computed 4 texels at a time with SSE2 when available (SimplexNoise is a template, instantiated with float and with a 4-wide SSE type); the scalar reference (Reference) follows the GLSL code line by line, with glm.
+Verify compares the baked values with the fBm computed by the reference at the true position of each octave, and the SSE version with the scalar one.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define NOISE_SIMD 1
+#endif
+
+// texels of each side of the texture, period of the noise (in units of the noise) and octaves (layers of the texture)
+#define NOISE_SIZE 512
+#define NOISE_PERIOD 8
+#define NOISE_OCTAVES 5
+// upper bound of the gradient of the tileable noise (the largest measured is about 5.1), used for the tolerance of the check of the bake
+#define NOISE_MAX_SLOPE 6.0f
+
+#ifdef NOISE_SIMD
+// 4 floats processed with SSE2, with the operators and functions used by SimplexNoise
+struct Float4 {
+    __m128 v;
+    Float4() {}
+    Float4(__m128 v): v(v) {}
+    Float4(float f): v(_mm_set1_ps(f)) {}
+};
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+inline Float4 noiseFloor(Float4 a)
+{
+    // truncation, minus 1 for the negative values with a fractional part
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+inline Float4 noiseMin(Float4 a, Float4 b) { return _mm_min_ps(a.v, b.v); }
+inline Float4 noiseMax(Float4 a, Float4 b) { return _mm_max_ps(a.v, b.v); }
+inline Float4 noiseAbs(Float4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+// GLSL step: 0 if x < edge, 1 otherwise
+inline Float4 noiseStep(Float4 edge, Float4 x) { return _mm_and_ps(_mm_cmpge_ps(x.v, edge.v), _mm_set1_ps(1.0f)); }
+#endif
+
+inline float noiseFloor(float a) { return std::floor(a); }
+inline float noiseMin(float a, float b) { return std::min(a, b); }
+inline float noiseMax(float a, float b) { return std::max(a, b); }
+inline float noiseAbs(float a) { return std::fabs(a); }
+inline float noiseStep(float edge, float x) { return x < edge ? 0.0f : 1.0f; }
+
+class NoiseBaker
+{
+public:
+    //////////////////////////////////////////
+    // scalar reference: the GLSL snoise, with glm types and functions
+    static glm::vec3 mod289(glm::vec3 x) { return x - glm::floor(x * (1.0f / 289.0f)) * 289.0f; }
+    static glm::vec4 mod289(glm::vec4 x) { return x - glm::floor(x * (1.0f / 289.0f)) * 289.0f; }
+    static glm::vec4 permute(glm::vec4 x) { return mod289(((x * 34.0f) + 1.0f) * x); }
+    static glm::vec4 taylorInvSqrt(glm::vec4 r) { return 1.79284291400159f - 0.85373472095314f * r; }
+
+    static float Reference(glm::vec3 v)
+    {
+        const glm::vec2 C = glm::vec2(1.0f / 6.0f, 1.0f / 3.0f);
+        const glm::vec4 D = glm::vec4(0.0f, 0.5f, 1.0f, 2.0f);
+        // First corner
+        glm::vec3 i = glm::floor(v + glm::dot(v, glm::vec3(C.y)));
+        glm::vec3 x0 = v - i + glm::dot(i, glm::vec3(C.x));
+        // Other corners
+        glm::vec3 g = glm::step(glm::vec3(x0.y, x0.z, x0.x), x0);
+        glm::vec3 l = 1.0f - g;
+        glm::vec3 i1 = glm::min(g, glm::vec3(l.z, l.x, l.y));
+        glm::vec3 i2 = glm::max(g, glm::vec3(l.z, l.x, l.y));
+        glm::vec3 x1 = x0 - i1 + C.x;
+        glm::vec3 x2 = x0 - i2 + C.y;
+        glm::vec3 x3 = x0 - D.y;
+        // Permutations
+        i = mod289(i);
+        glm::vec4 p = permute(permute(permute(
+                        i.z + glm::vec4(0.0f, i1.z, i2.z, 1.0f))
+                      + i.y + glm::vec4(0.0f, i1.y, i2.y, 1.0f))
+                      + i.x + glm::vec4(0.0f, i1.x, i2.x, 1.0f));
+        // Gradients: 7x7 points over a square, mapped onto an octahedron.
+        float n_ = 0.142857142857f;
+        glm::vec3 ns = n_ * glm::vec3(D.w, D.y, D.z) - glm::vec3(D.x, D.z, D.x);
+        glm::vec4 j = p - 49.0f * glm::floor(p * ns.z * ns.z);
+        glm::vec4 x_ = glm::floor(j * ns.z);
+        glm::vec4 y_ = glm::floor(j - 7.0f * x_);
+        glm::vec4 x = x_ * ns.x + ns.y;
+        glm::vec4 y = y_ * ns.x + ns.y;
+        glm::vec4 h = 1.0f - glm::abs(x) - glm::abs(y);
+        glm::vec4 b0 = glm::vec4(x.x, x.y, y.x, y.y);
+        glm::vec4 b1 = glm::vec4(x.z, x.w, y.z, y.w);
+        glm::vec4 s0 = glm::floor(b0) * 2.0f + 1.0f;
+        glm::vec4 s1 = glm::floor(b1) * 2.0f + 1.0f;
+        glm::vec4 sh = -glm::step(h, glm::vec4(0.0f));
+        glm::vec4 a0 = glm::vec4(b0.x, b0.z, b0.y, b0.w) + glm::vec4(s0.x, s0.z, s0.y, s0.w) * glm::vec4(sh.x, sh.x, sh.y, sh.y);
+        glm::vec4 a1 = glm::vec4(b1.x, b1.z, b1.y, b1.w) + glm::vec4(s1.x, s1.z, s1.y, s1.w) * glm::vec4(sh.z, sh.z, sh.w, sh.w);
+        glm::vec3 p0 = glm::vec3(a0.x, a0.y, h.x);
+        glm::vec3 p1 = glm::vec3(a0.z, a0.w, h.y);
+        glm::vec3 p2 = glm::vec3(a1.x, a1.y, h.z);
+        glm::vec3 p3 = glm::vec3(a1.z, a1.w, h.w);
+        // Normalise gradients
+        glm::vec4 norm = taylorInvSqrt(glm::vec4(glm::dot(p0, p0), glm::dot(p1, p1), glm::dot(p2, p2), glm::dot(p3, p3)));
+        p0 *= norm.x;
+        p1 *= norm.y;
+        p2 *= norm.z;
+        p3 *= norm.w;
+        // Mix final noise value
+        glm::vec4 m = glm::max(0.6f - glm::vec4(glm::dot(x0, x0), glm::dot(x1, x1), glm::dot(x2, x2), glm::dot(x3, x3)), 0.0f);
+        m = m * m;
+        return 42.0f * glm::dot(m * m, glm::vec4(glm::dot(p0, x0), glm::dot(p1, x1), glm::dot(p2, x2), glm::dot(p3, x3)));
+    }
+
+    //////////////////////////////////////////
+    // the same algorithm, written component by component, so that T can be float or Float4 (4 points at a time)
+    template<typename T>
+    static T SimplexNoise(T vx, T vy, T vz)
+    {
+        // First corner
+        T s = (vx + vy + vz) * T(1.0f / 3.0f);
+        T ix = noiseFloor(vx + s), iy = noiseFloor(vy + s), iz = noiseFloor(vz + s);
+        T t = (ix + iy + iz) * T(1.0f / 6.0f);
+        T x0[3] = {vx - ix + t, vy - iy + t, vz - iz + t};
+        // Other corners
+        T gx = noiseStep(x0[1], x0[0]), gy = noiseStep(x0[2], x0[1]), gz = noiseStep(x0[0], x0[2]);
+        T lx = T(1.0f) - gx, ly = T(1.0f) - gy, lz = T(1.0f) - gz;
+        T i1[3] = {noiseMin(gx, lz), noiseMin(gy, lx), noiseMin(gz, ly)};
+        T i2[3] = {noiseMax(gx, lz), noiseMax(gy, lx), noiseMax(gz, ly)};
+        T corners[4][3];
+        for(int c = 0; c < 3; c++){
+            corners[0][c] = x0[c];
+            corners[1][c] = x0[c] - i1[c] + T(1.0f / 6.0f);
+            corners[2][c] = x0[c] - i2[c] + T(1.0f / 3.0f);
+            corners[3][c] = x0[c] - T(0.5f);
+        }
+        // Permutations
+        ix = mod289(ix);
+        iy = mod289(iy);
+        iz = mod289(iz);
+        T offsets[4][3] = {{T(0.0f), T(0.0f), T(0.0f)}, {i1[0], i1[1], i1[2]}, {i2[0], i2[1], i2[2]}, {T(1.0f), T(1.0f), T(1.0f)}};
+        T result = T(0.0f);
+        for(int k = 0; k < 4; k++){
+            T p = permute(permute(permute(iz + offsets[k][2]) + iy + offsets[k][1]) + ix + offsets[k][0]);
+            // Gradients: 7x7 points over a square, mapped onto an octahedron.
+            const float nsx = 2.0f * 0.142857142857f, nsy = 0.5f * 0.142857142857f - 1.0f, nsz = 0.142857142857f;
+            T j = p - T(49.0f) * noiseFloor(p * T(nsz) * T(nsz));
+            T x_ = noiseFloor(j * T(nsz));
+            T y_ = noiseFloor(j - T(7.0f) * x_);
+            T x = x_ * T(nsx) + T(nsy);
+            T y = y_ * T(nsx) + T(nsy);
+            T h = T(1.0f) - noiseAbs(x) - noiseAbs(y);
+            T sh = -noiseStep(h, T(0.0f));
+            T px = x + (noiseFloor(x) * T(2.0f) + T(1.0f)) * sh;
+            T py = y + (noiseFloor(y) * T(2.0f) + T(1.0f)) * sh;
+            // Normalise gradients
+            T norm = T(1.79284291400159f) - T(0.85373472095314f) * (px * px + py * py + h * h);
+            T* xk = corners[k];
+            // Mix final noise value
+            T m = noiseMax(T(0.6f) - (xk[0] * xk[0] + xk[1] * xk[1] + xk[2] * xk[2]), T(0.0f));
+            m = m * m;
+            result = result + m * m * ((px * xk[0] + py * xk[1] + h * xk[2]) * norm);
+        }
+        return T(42.0f) * result;
+    }
+
+    //////////////////////////////////////////
+    // tileable noise (z = 0), with the scalar reference
+    static float TileableReference(float x, float y)
+    {
+        const float P = NOISE_PERIOD;
+        return (Reference(glm::vec3(x, y, 0.0f)) * (P - x) * (P - y) + Reference(glm::vec3(x - P, y, 0.0f)) * x * (P - y)
+              + Reference(glm::vec3(x, y - P, 0.0f)) * (P - x) * y + Reference(glm::vec3(x - P, y - P, 0.0f)) * x * y) / (P * P);
+    }
+
+    template<typename T>
+    static T Tileable(T x, T y)
+    {
+        const T P = T((float)NOISE_PERIOD);
+        T zero = T(0.0f);
+        return (SimplexNoise(x, y, zero) * (P - x) * (P - y) + SimplexNoise(x - P, y, zero) * x * (P - y)
+              + SimplexNoise(x, y - P, zero) * (P - x) * y + SimplexNoise(x - P, y - P, zero) * x * y) * T(1.0f / (NOISE_PERIOD * NOISE_PERIOD));
+    }
+
+    // fBm of the first octaves at the point (x, y), with the scalar reference: octave o is evaluated at its true position 2^o (x, y) mod P,
+    // independently from the texels of the bake
+    static float FbmReference(float x, float y, int octaves)
+    {
+        float value = 0.0f, p = 1.0f, f = 1.0f;
+        for(int o = 0; o < octaves; o++){
+            value += p * TileableReference(fmod(f * x, (float)NOISE_PERIOD), fmod(f * y, (float)NOISE_PERIOD));
+            p *= 0.5f;
+            f *= 2.0f;
+        }
+        return value;
+    }
+
+    // largest difference between the bake and the reference at the center of a texel, due to the texel snapping:
+    // the bake reads octave o at the center of the texel 2^o x, which is (2^o - 1) / 2 texels (per axis) from the true position,
+    // and the tileable noise changes at most NOISE_MAX_SLOPE per unit
+    static float SnapTolerance(int octaves)
+    {
+        float tolerance = 0.0f, p = 1.0f, f = 1.0f;
+        for(int o = 0; o < octaves; o++){
+            tolerance += p * NOISE_MAX_SLOPE * 1.41421356f * (f - 1.0f) * 0.5f * NOISE_PERIOD / NOISE_SIZE;
+            p *= 0.5f;
+            f *= 2.0f;
+        }
+        return tolerance;
+    }
+
+    //////////////////////////////////////////
+    // it returns the layers of the texture (NOISE_OCTAVES layers of NOISE_SIZE x NOISE_SIZE floats): the layer k is the fBm of the first k + 1 octaves
+    static vector<float> Bake(bool simd = true)
+    {
+        // first octave
+        vector<float> octave(NOISE_SIZE * NOISE_SIZE);
+        for(int y = 0; y < NOISE_SIZE; y++){
+            int x = 0;
+#ifdef NOISE_SIMD
+            if(simd){
+                Float4 py(TexelPosition(y));
+                for(; x + 4 <= NOISE_SIZE; x += 4){
+                    Float4 px(_mm_setr_ps(TexelPosition(x), TexelPosition(x + 1), TexelPosition(x + 2), TexelPosition(x + 3)));
+                    _mm_storeu_ps(&octave[y * NOISE_SIZE + x], Tileable(px, py).v);
+                }
+            }
+#endif
+            for(; x < NOISE_SIZE; x++)
+                octave[y * NOISE_SIZE + x] = Tileable(TexelPosition(x), TexelPosition(y));
+        }
+
+        // the layers are accumulated from the first octave
+        vector<float> layers(NOISE_OCTAVES * NOISE_SIZE * NOISE_SIZE);
+        for(int y = 0; y < NOISE_SIZE; y++)
+            for(int x = 0; x < NOISE_SIZE; x++){
+                float value = 0.0f, p = 1.0f;
+                for(int o = 0; o < NOISE_OCTAVES; o++){
+                    value += p * octave[((y << o) % NOISE_SIZE) * NOISE_SIZE + (x << o) % NOISE_SIZE];
+                    p *= 0.5f;
+                    layers[(o * NOISE_SIZE + y) * NOISE_SIZE + x] = value;
+                }
+            }
+        return layers;
+    }
+
+    //////////////////////////////////////////
+    // CPU test: largest difference between the baked layers and the scalar reference (on random texels), beyond the tolerance for the texel snapping (see SnapTolerance),
+    // and between the SSE and the scalar noise (on random points)
+    // the seam of the tileable noise is checked too: the value at x = P must be the one at x = 0
+    static void Verify(const vector<float>& layers, float& bakeError, float& simdError, float& seamError, int samples = 1024)
+    {
+        std::mt19937 generator(4321);
+        std::uniform_int_distribution<int> texel(0, NOISE_SIZE - 1);
+        std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+        bakeError = simdError = seamError = 0.0f;
+        for(int s = 0; s < samples; s++){
+            int x = texel(generator), y = texel(generator), o = s % NOISE_OCTAVES;
+            float baked = layers[(o * NOISE_SIZE + y) * NOISE_SIZE + x];
+            float difference = fabs(baked - FbmReference(TexelPosition(x), TexelPosition(y), o + 1));
+            bakeError = std::max(bakeError, difference - SnapTolerance(o + 1));
+
+            float px[4], py[4], pz[4], simd[4];
+            for(int i = 0; i < 4; i++){
+                px[i] = position(generator);
+                py[i] = position(generator);
+                pz[i] = position(generator);
+            }
+#ifdef NOISE_SIMD
+            _mm_storeu_ps(simd, SimplexNoise(Float4(_mm_loadu_ps(px)), Float4(_mm_loadu_ps(py)), Float4(_mm_loadu_ps(pz))).v);
+#else
+            for(int i = 0; i < 4; i++)
+                simd[i] = SimplexNoise(px[i], py[i], pz[i]);
+#endif
+            for(int i = 0; i < 4; i++)
+                simdError = std::max(simdError, fabs(simd[i] - Reference(glm::vec3(px[i], py[i], pz[i]))));
+
+            float t = TexelPosition(texel(generator));
+            seamError = std::max(seamError, fabs(TileableReference((float)NOISE_PERIOD, t) - TileableReference(0.0f, t)));
+        }
+    }
+
+private:
+    // position in units of the noise of the center of a texel
+    static float TexelPosition(int texel)
+    {
+        return (texel + 0.5f) * NOISE_PERIOD / NOISE_SIZE;
+    }
+
+    template<typename T>
+    static T mod289(T x) { return x - noiseFloor(x * T(1.0f / 289.0f)) * T(289.0f); }
+    template<typename T>
+    static T permute(T x) { return mod289(((x * T(34.0f)) + T(1.0f)) * x); }
+};
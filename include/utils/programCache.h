@@ -0,0 +1,129 @@
+/*
+Program binary cache
+- after the first link of a Shader Program, its binary (glGetProgramBinary) is saved in a file next to the source of its last shader
+- in the following runs, the binary is loaded with glProgramBinary, without compiling and linking the shaders
+
+The cache is valid only if it has been created from the same sources (we compare a hash of their content) and by the same driver (hash of vendor, renderer and version strings):
+changing a shader invalidates only the programs using it. The driver can also reject a binary (e.g., after an update with the same version string): in that case, the program is compiled again.
+
+File layout:
+    header: magic "RTGPPROG", format version, source hash, driver hash, binary format, binary length
+    binary
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+// the version must be incremented every time the layout of the file changes
+#define PROGRAM_CACHE_VERSION 1
+// the cache file is saved next to the source of the last shader of the program, adding this extension
+#define PROGRAM_CACHE_EXTENSION ".programcache"
+
+struct ProgramCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint64_t driverHash;
+    uint32_t binaryFormat;
+    uint32_t binaryLength;
+};
+
+class ProgramCache
+{
+public:
+    // 64 bit FNV-1a hash of a string, continuing from a previous hash
+    static uint64_t Hash(const string& text, uint64_t hash = 14695981039346656037ULL)
+    {
+        for(size_t i = 0; i < text.size(); i++){
+            hash ^= (unsigned char)text[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // hash of the driver of the current context
+    static uint64_t DriverHash()
+    {
+        string driver;
+        const GLenum names[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+        for(int i = 0; i < 3; i++){
+            const GLubyte* name = glGetString(names[i]);
+            driver += name ? (const char*)name : "";
+            driver += '\n';
+        }
+        return Hash(driver);
+    }
+
+    // the binaries can be saved only if the driver supports at least a binary format
+    static bool Supported()
+    {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    //////////////////////////////////////////
+    // it loads the binary in the program, if the cache file is valid for the given hashes and the driver accepts it
+    static bool Load(const string& cachePath, uint64_t sourceHash, uint64_t driverHash, GLuint program)
+    {
+        ifstream file(cachePath, ios::binary);
+        if(!file)
+            return false;
+        ProgramCacheHeader header;
+        if(!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "RTGPPROG", 8) != 0 || header.version != PROGRAM_CACHE_VERSION ||
+           header.sourceHash != sourceHash || header.driverHash != driverHash || header.binaryLength == 0)
+            return false;
+        vector<char> binary(header.binaryLength);
+        if(!file.read(binary.data(), binary.size()))
+            return false;
+
+        glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
+    }
+
+    // it saves the binary of a linked program (created with GL_PROGRAM_BINARY_RETRIEVABLE_HINT)
+    // it writes a temporary file, renamed at the end, so an interrupted write does not leave an invalid cache
+    static bool Save(const string& cachePath, uint64_t sourceHash, uint64_t driverHash, GLuint program)
+    {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+            return false;
+        vector<char> binary(length);
+        GLenum binaryFormat = 0;
+        glGetProgramBinary(program, length, &length, &binaryFormat, binary.data());
+
+        ProgramCacheHeader header;
+        memcpy(header.magic, "RTGPPROG", 8);
+        header.version = PROGRAM_CACHE_VERSION;
+        header.sourceHash = sourceHash;
+        header.driverHash = driverHash;
+        header.binaryFormat = binaryFormat;
+        header.binaryLength = (uint32_t)length;
+        string tmpPath = cachePath + ".tmp";
+        ofstream file(tmpPath.c_str(), ios::binary | ios::trunc);
+        if(!file)
+            return false;
+        file.write((const char*)&header, sizeof(header));
+        file.write(binary.data(), length);
+        file.close();
+        if(!file){
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        std::remove(cachePath.c_str());
+        return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+    }
+};
@@ -0,0 +1,414 @@
+/*
+RenderGraph class
+- the passes of the frame declare their inputs and outputs (targets, by name), and the graph allocates the textures and the framebuffers they need
+- the passes whose outputs are not read (directly or through other passes) by the root target are culled, and their targets are not allocated;
+  the outputs of a pass not read by any following pass are not attached (the pass writes them to GL_NONE)
+- the transient targets with the same size and format share a texture if their lifetimes (from the first pass writing them to the last pass reading them) do not overlap
+- only the targets with a depth format are attached as depth buffers: the other passes have no depth attachment
+
+The passes are declared at each frame, in the order of execution (Begin, Target/Import, Pass), and Compile builds the graph again only if the declaration has changed.
+The textures are kept in a pool across the compilations: a texture not used by the current graph is deleted after RENDER_GRAPH_IDLE_FRAMES frames.
+A target declared with preserve = true has its own texture, which keeps its content across the frames (e.g., when it is written only in some areas).
+Imported targets (e.g., the default framebuffer, or targets managed by the application) are never allocated.
+The execution of the passes remains in the application: Enabled tells if a pass has been culled, Texture and BindFramebuffer return the resources allocated for it.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <map>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// frames before deleting a texture of the pool not used by the graph
+#define RENDER_GRAPH_IDLE_FRAMES 240
+
+class RenderGraph
+{
+public:
+    // statistics of the last compilation
+    int livePasses, culledPasses;
+    // targets allocated by the graph, textures they use, and memory with and without the aliasing
+    int liveTargets, textures;
+    size_t textureBytes, targetBytes;
+    int compilations;
+
+    RenderGraph(): livePasses(0), culledPasses(0), liveTargets(0), textures(0), textureBytes(0), targetBytes(0), compilations(0) {}
+
+    RenderGraph(const RenderGraph& copy) = delete;
+    RenderGraph& operator=(const RenderGraph& copy) = delete;
+
+    //////////////////////////////////////////
+    // declaration of the graph of the frame
+    void Begin()
+    {
+        this->declaredTargets.clear();
+        this->declaredPasses.clear();
+    }
+
+    // format: GL_RGBA8, GL_RGBA16F, GL_R11F_G11F_B10F, GL_R8 or GL_DEPTH_COMPONENT24
+    void Target(const string& name, int width, int height, GLenum format, bool preserve = false)
+    {
+        TargetInfo target;
+        target.width = width;
+        target.height = height;
+        target.format = format;
+        target.preserve = preserve;
+        target.imported = false;
+        this->declaredTargets[name] = target;
+    }
+
+    void Import(const string& name)
+    {
+        TargetInfo target;
+        target.width = target.height = 0;
+        target.format = GL_NONE;
+        target.preserve = false;
+        target.imported = true;
+        this->declaredTargets[name] = target;
+    }
+
+    void Pass(const string& name, const vector<string>& inputs, const vector<string>& outputs)
+    {
+        PassInfo pass;
+        pass.name = name;
+        pass.inputs = inputs;
+        pass.outputs = outputs;
+        this->declaredPasses.push_back(pass);
+    }
+
+    //////////////////////////////////////////
+    // it builds the graph again if the declaration has changed (it returns true in that case), and deletes the textures not used for too long
+    bool Compile(const string& root)
+    {
+        string key = this->Key(root);
+        bool changed = key != this->compiledKey;
+        if(changed){
+            this->ReleaseFramebuffers();
+            this->targets = this->declaredTargets;
+            this->passes = this->declaredPasses;
+            this->compiledKey = key;
+            this->Cull(root);
+            this->Allocate();
+            this->CreateFramebuffers();
+            this->compilations++;
+        }
+        // the textures of the pool not used by the current graph are deleted after some frames
+        for(size_t i = 0; i < this->pool.size();){
+            if(this->pool[i].users == 0 && ++this->pool[i].idleFrames > RENDER_GRAPH_IDLE_FRAMES){
+                glDeleteTextures(1, &this->pool[i].texture);
+                this->pool.erase(this->pool.begin() + i);
+                this->RemapAfterErase((int)i);
+            }
+            else
+                i++;
+        }
+        return changed;
+    }
+
+    bool Enabled(const string& pass) const
+    {
+        const PassInfo* p = this->FindPass(pass);
+        return p && p->live;
+    }
+
+    // texture of a target (0 for the imported targets, and for the targets not allocated)
+    GLuint Texture(const string& name) const
+    {
+        map<string, TargetInfo>::const_iterator t = this->targets.find(name);
+        if(t == this->targets.end() || t->second.physical < 0)
+            return 0;
+        return this->pool[t->second.physical].texture;
+    }
+
+    // it binds the framebuffer of a pass (0 if it writes only imported targets), selects its draw buffers, and sets the viewport to the size of its outputs
+    void BindFramebuffer(const string& pass) const
+    {
+        const PassInfo* p = this->FindPass(pass);
+        if(!p || !p->fbo){
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            return;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, p->fbo);
+        if(!p->drawBuffers.empty())
+            glDrawBuffers((GLsizei)p->drawBuffers.size(), p->drawBuffers.data());
+        glViewport(0, 0, p->width, p->height);
+    }
+
+    void Release()
+    {
+        this->ReleaseFramebuffers();
+        for(size_t i = 0; i < this->pool.size(); i++)
+            glDeleteTextures(1, &this->pool[i].texture);
+        this->pool.clear();
+        this->targets.clear();
+        this->passes.clear();
+        this->compiledKey.clear();
+    }
+
+private:
+    struct TargetInfo {
+        int width, height;
+        GLenum format;
+        bool preserve, imported;
+        // index of the texture in the pool (-1 if not allocated), and first and last pass using the target
+        int physical;
+        int first, last;
+        TargetInfo(): width(0), height(0), format(GL_NONE), preserve(false), imported(false), physical(-1), first(-1), last(-1) {}
+    };
+    struct PassInfo {
+        string name;
+        vector<string> inputs, outputs;
+        bool live;
+        // outputs read by the following passes (or root)
+        vector<bool> liveOutputs;
+        GLuint fbo;
+        vector<GLenum> drawBuffers;
+        int width, height;
+        PassInfo(): live(false), fbo(0), width(0), height(0) {}
+    };
+    struct PooledTexture {
+        int width, height;
+        GLenum format;
+        GLuint texture;
+        // targets of the current graph using the texture, pass after which it is free again, target owning it (preserved targets), frames without users
+        int users;
+        int busyUntil;
+        string owner;
+        int idleFrames;
+    };
+
+    map<string, TargetInfo> declaredTargets, targets;
+    vector<PassInfo> declaredPasses, passes;
+    vector<PooledTexture> pool;
+    string compiledKey;
+
+    string Key(const string& root) const
+    {
+        ostringstream key;
+        key << root << ';';
+        for(map<string, TargetInfo>::const_iterator t = this->declaredTargets.begin(); t != this->declaredTargets.end(); ++t)
+            key << t->first << ':' << t->second.width << 'x' << t->second.height << ':' << t->second.format << ':' << t->second.preserve << t->second.imported << ';';
+        for(size_t p = 0; p < this->declaredPasses.size(); p++){
+            key << this->declaredPasses[p].name << '(';
+            for(size_t i = 0; i < this->declaredPasses[p].inputs.size(); i++)
+                key << this->declaredPasses[p].inputs[i] << ',';
+            key << ")->(";
+            for(size_t o = 0; o < this->declaredPasses[p].outputs.size(); o++)
+                key << this->declaredPasses[p].outputs[o] << ',';
+            key << ");";
+        }
+        return key.str();
+    }
+
+    const PassInfo* FindPass(const string& name) const
+    {
+        for(size_t p = 0; p < this->passes.size(); p++)
+            if(this->passes[p].name == name)
+                return &this->passes[p];
+        return nullptr;
+    }
+
+    //////////////////////////////////////////
+    // from the last pass to the first: a pass is live if it writes a target needed by the following passes (or the root), and then its inputs are needed
+    void Cull(const string& root)
+    {
+        vector<string> needed(1, root);
+        this->livePasses = this->culledPasses = 0;
+        for(int p = (int)this->passes.size() - 1; p >= 0; p--){
+            PassInfo& pass = this->passes[p];
+            pass.liveOutputs.assign(pass.outputs.size(), false);
+            for(size_t o = 0; o < pass.outputs.size(); o++)
+                pass.liveOutputs[o] = std::find(needed.begin(), needed.end(), pass.outputs[o]) != needed.end();
+            pass.live = std::find(pass.liveOutputs.begin(), pass.liveOutputs.end(), true) != pass.liveOutputs.end();
+            if(!pass.live){
+                this->culledPasses++;
+                continue;
+            }
+            this->livePasses++;
+            needed.insert(needed.end(), pass.inputs.begin(), pass.inputs.end());
+        }
+
+        // lifetimes of the targets written by the live passes
+        for(size_t p = 0; p < this->passes.size(); p++){
+            const PassInfo& pass = this->passes[p];
+            if(!pass.live)
+                continue;
+            for(size_t o = 0; o < pass.outputs.size(); o++){
+                TargetInfo* target = this->Find(pass.outputs[o]);
+                if(!target || !pass.liveOutputs[o])
+                    continue;
+                if(target->first < 0)
+                    target->first = (int)p;
+                target->last = (int)p;
+            }
+            for(size_t i = 0; i < pass.inputs.size(); i++){
+                TargetInfo* target = this->Find(pass.inputs[i]);
+                if(!target)
+                    cout << "Render graph: the pass " << pass.name << " reads the undeclared target " << pass.inputs[i] << endl;
+                else if(target->first >= 0)
+                    target->last = (int)p;
+                else if(!target->imported)
+                    cout << "Render graph: the pass " << pass.name << " reads " << pass.inputs[i] << " before it is written" << endl;
+            }
+        }
+    }
+
+    TargetInfo* Find(const string& name)
+    {
+        map<string, TargetInfo>::iterator t = this->targets.find(name);
+        return t == this->targets.end() ? nullptr : &t->second;
+    }
+
+    //////////////////////////////////////////
+    // the targets are assigned to the textures of the pool in the order of their first pass: a texture with the same size and format is reused if its last target is no longer used
+    void Allocate()
+    {
+        for(size_t i = 0; i < this->pool.size(); i++){
+            this->pool[i].users = 0;
+            this->pool[i].busyUntil = -1;
+        }
+        this->liveTargets = 0;
+        this->targetBytes = 0;
+        for(size_t p = 0; p < this->passes.size(); p++){
+            for(size_t o = 0; o < this->passes[p].outputs.size(); o++){
+                TargetInfo* target = this->Find(this->passes[p].outputs[o]);
+                if(!target || target->imported || target->first != (int)p || target->physical >= 0)
+                    continue;
+                int texture = -1;
+                for(size_t i = 0; i < this->pool.size() && texture < 0; i++){
+                    PooledTexture& pooled = this->pool[i];
+                    if(pooled.width != target->width || pooled.height != target->height || pooled.format != target->format)
+                        continue;
+                    // a preserved target gets back its texture; the other targets share the textures not owned by a preserved target
+                    if(target->preserve ? pooled.owner == this->passes[p].outputs[o] : (pooled.owner.empty() && pooled.busyUntil < (int)p))
+                        texture = (int)i;
+                }
+                if(texture < 0){
+                    texture = (int)this->pool.size();
+                    this->pool.push_back(this->CreateTexture(target->width, target->height, target->format));
+                    if(target->preserve)
+                        this->pool.back().owner = this->passes[p].outputs[o];
+                }
+                target->physical = texture;
+                this->pool[texture].users++;
+                this->pool[texture].busyUntil = target->preserve ? (int)this->passes.size() : target->last;
+                this->pool[texture].idleFrames = 0;
+                this->liveTargets++;
+                this->targetBytes += Bytes(target->width, target->height, target->format);
+            }
+        }
+        // a preserved texture without its target can be used by the other targets
+        this->textures = 0;
+        this->textureBytes = 0;
+        for(size_t i = 0; i < this->pool.size(); i++){
+            if(this->pool[i].users == 0)
+                this->pool[i].owner.clear();
+            else{
+                this->textures++;
+                this->textureBytes += Bytes(this->pool[i].width, this->pool[i].height, this->pool[i].format);
+            }
+        }
+    }
+
+    void RemapAfterErase(int erased)
+    {
+        for(map<string, TargetInfo>::iterator t = this->targets.begin(); t != this->targets.end(); ++t)
+            if(t->second.physical > erased)
+                t->second.physical--;
+    }
+
+    static size_t Bytes(int width, int height, GLenum format)
+    {
+        size_t pixel = format == GL_RGBA16F ? 8 : (format == GL_R8 ? 1 : 4);
+        return (size_t)width * height * pixel;
+    }
+
+    PooledTexture CreateTexture(int width, int height, GLenum format)
+    {
+        PooledTexture pooled;
+        pooled.width = width;
+        pooled.height = height;
+        pooled.format = format;
+        pooled.users = 0;
+        pooled.busyUntil = -1;
+        pooled.idleFrames = 0;
+        glGenTextures(1, &pooled.texture);
+        glBindTexture(GL_TEXTURE_2D, pooled.texture);
+        if(format == GL_DEPTH_COMPONENT24){
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            // we set to clamp the uv coordinates outside [0,1] to the color of the border
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        }
+        else{
+            GLenum channels = format == GL_R8 ? GL_RED : (format == GL_R11F_G11F_B10F ? GL_RGB : GL_RGBA);
+            GLenum type = format == GL_RGBA16F || format == GL_R11F_G11F_B10F ? GL_FLOAT : GL_UNSIGNED_BYTE;
+            glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, channels, type, NULL);
+            // the targets can be read with a different size from the one they have (render scale, pyramid): we use bilinear filtering
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return pooled;
+    }
+
+    //////////////////////////////////////////
+    // a framebuffer for each live pass writing allocated targets: the color outputs are attached in the order of declaration (GL_NONE for the outputs not read)
+    void CreateFramebuffers()
+    {
+        for(size_t p = 0; p < this->passes.size(); p++){
+            PassInfo& pass = this->passes[p];
+            if(!pass.live)
+                continue;
+            int color = 0;
+            for(size_t o = 0; o < pass.outputs.size(); o++){
+                TargetInfo* target = this->Find(pass.outputs[o]);
+                if(!target || target->imported)
+                    continue;
+                bool attached = pass.liveOutputs[o] && target->physical >= 0;
+                if(attached && !pass.fbo){
+                    glGenFramebuffers(1, &pass.fbo);
+                    glBindFramebuffer(GL_FRAMEBUFFER, pass.fbo);
+                    pass.width = target->width;
+                    pass.height = target->height;
+                }
+                if(target->format == GL_DEPTH_COMPONENT24){
+                    if(attached)
+                        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->pool[target->physical].texture, 0);
+                    continue;
+                }
+                if(attached)
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + color, GL_TEXTURE_2D, this->pool[target->physical].texture, 0);
+                pass.drawBuffers.push_back(attached ? GL_COLOR_ATTACHMENT0 + color : GL_NONE);
+                color++;
+            }
+            if(!pass.fbo)
+                continue;
+            GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+            if(status != GL_FRAMEBUFFER_COMPLETE)
+                cout << "Render graph: framebuffer of the pass " << pass.name << " error: " << status << endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    void ReleaseFramebuffers()
+    {
+        for(size_t p = 0; p < this->passes.size(); p++){
+            if(this->passes[p].fbo)
+                glDeleteFramebuffers(1, &this->passes[p].fbo);
+            this->passes[p].fbo = 0;
+            this->passes[p].drawBuffers.clear();
+        }
+    }
+};
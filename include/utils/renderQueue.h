@@ -0,0 +1,212 @@
+/*
+RenderQueue class
+- collects the draw packets of a frame, each one described by a 64 bit sort key
+- sorts the packets with a LSD radix sort on the key, and submits them in order, changing the OpenGL state (Shader Program, subroutine, VAO) only when needed
+
+Key layout (from the most significant bit):
+    4 bits  pass (e.g. opaque objects, skybox)
+    12 bits Shader Program
+    8 bits  fragment shader subroutine
+    16 bits VAO
+    24 bits depth (front-to-back)
+
+This way, packets sharing the same program are contiguous, and inside each program packets sharing the same subroutine and the same VAO are contiguous too.
+*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <utils/gameObject.h>
+
+#define RQ_PASS_BITS 4
+#define RQ_PROGRAM_BITS 12
+#define RQ_SUBROUTINE_BITS 8
+#define RQ_VAO_BITS 16
+#define RQ_DEPTH_BITS 24
+
+// passes are drawn in this order
+enum renderPass{
+    PASS_OPAQUE=0,
+    PASS_SKYBOX=1
+};
+
+struct DrawPacket {
+    uint64_t key;
+    unsigned int pass;
+    GLuint program;
+    GLuint subroutine;
+    Mesh* mesh;
+    // Level of Detail of the mesh to draw
+    int lod;
+    // the object providing the per-draw uniforms (nullptr if the pass sets everything)
+    GameObject* object;
+};
+
+// statistics about the last submitted frame
+struct RenderQueueStats {
+    int drawCalls;
+    int programBinds;
+    int subroutineBinds;
+    int vaoBinds;
+    // binds we would have done setting program, subroutine and VAO (plus the VAO unbind) for every draw
+    int naiveBinds;
+};
+
+class RenderQueue
+{
+public:
+    RenderQueueStats stats;
+
+    // if >= 0, all the meshes are drawn with this LOD (clamped to the available ones), to compare them
+    int forcedLOD;
+
+    RenderQueue(float nearPlane, float farPlane): forcedLOD(-1), nearPlane(nearPlane), farPlane(farPlane), pixelsPerUnitAtOne(1.0f) {
+        stats = RenderQueueStats();
+    }
+
+    // it sets the size on screen (in pixels) of a unit at distance 1 from the camera, used to choose the LODs
+    void SetProjection(glm::mat4 &projection, float screenHeight){
+        pixelsPerUnitAtOne = 0.5f * screenHeight * projection[1][1];
+    }
+
+    void Clear(){
+        packets.clear();
+    }
+
+    // it adds a packet for each mesh of the model of the object
+    // the depth is the view space distance of the object origin, used to sort front-to-back the packets with the same state, and to choose the LOD of the meshes
+    void Submit(unsigned int pass, GLuint program, GLuint subroutine, GameObject* object, glm::mat4 &view){
+        glm::vec4 viewPos = view * object->ModelMatrix() * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        float depth = -viewPos.z;
+        float maxScale = std::max(object->scale.x, std::max(object->scale.y, object->scale.z));
+        float pixelsPerUnit = pixelsPerUnitAtOne * maxScale / std::max(depth, nearPlane);
+        for(GLuint i = 0; i < object->model->meshes.size(); i++){
+            Mesh* mesh = &object->model->meshes[i];
+            int lod = forcedLOD >= 0 ? std::min(forcedLOD, (int)mesh->lods.size() - 1) : mesh->SelectLOD(pixelsPerUnit);
+            Submit(pass, program, subroutine, mesh, object, depth, lod);
+        }
+    }
+
+    void Submit(unsigned int pass, GLuint program, GLuint subroutine, Mesh* mesh, GameObject* object, float depth, int lod = 0){
+        DrawPacket p;
+        p.pass = pass;
+        p.program = program;
+        p.subroutine = subroutine;
+        p.mesh = mesh;
+        p.lod = lod;
+        p.object = object;
+        p.key = MakeKey(pass, program, subroutine, mesh->VAO, depth);
+        packets.push_back(p);
+    }
+
+    uint64_t MakeKey(unsigned int pass, GLuint program, GLuint subroutine, GLuint vao, float depth){
+        // the depth is normalized in [0,1] between near and far plane, and quantized
+        float d = (depth - nearPlane) / (farPlane - nearPlane);
+        d = d < 0.0f ? 0.0f : (d > 1.0f ? 1.0f : d);
+        uint64_t qdepth = (uint64_t)(d * (float)((1 << RQ_DEPTH_BITS) - 1));
+
+        uint64_t key = 0;
+        key |= (uint64_t)(pass & ((1 << RQ_PASS_BITS) - 1));
+        key = (key << RQ_PROGRAM_BITS) | (uint64_t)(program & ((1 << RQ_PROGRAM_BITS) - 1));
+        key = (key << RQ_SUBROUTINE_BITS) | (uint64_t)(subroutine & ((1 << RQ_SUBROUTINE_BITS) - 1));
+        key = (key << RQ_VAO_BITS) | (uint64_t)(vao & ((1 << RQ_VAO_BITS) - 1));
+        key = (key << RQ_DEPTH_BITS) | qdepth;
+        return key;
+    }
+
+    //////////////////////////////////////////
+    // LSD radix sort of the packets, 8 bits at a time
+    // the digits where all the keys are equal (e.g., the pass bits in most of the frames) are skipped
+    void Sort(){
+        size_t n = packets.size();
+        if(n < 2)
+            return;
+        sorted.resize(n);
+        for(int shift = 0; shift < 64; shift += 8){
+            size_t count[256] = {0};
+            for(size_t i = 0; i < n; i++)
+                count[(packets[i].key >> shift) & 0xFF]++;
+            // all the keys have the same digit: this pass would not change the order
+            if(count[(packets[0].key >> shift) & 0xFF] == n)
+                continue;
+            size_t offset = 0;
+            for(int b = 0; b < 256; b++){
+                size_t c = count[b];
+                count[b] = offset;
+                offset += c;
+            }
+            // stable scatter
+            for(size_t i = 0; i < n; i++)
+                sorted[count[(packets[i].key >> shift) & 0xFF]++] = packets[i];
+            packets.swap(sorted);
+        }
+    }
+
+    //////////////////////////////////////////
+    // it submits the packets in order
+    // beginPass is called when the pass changes, with the first Shader Program of the pass already active: it is used to set the uniforms and the OpenGL state shared by all the draws of the pass
+    void Flush(glm::mat4 &view, std::function<void(unsigned int pass)> beginPass){
+        stats = RenderQueueStats();
+        GLuint currentProgram = 0;
+        GLuint currentSubroutine = (GLuint)-1;
+        GLuint currentVAO = 0;
+        unsigned int currentPass = (unsigned int)-1;
+        Mesh* decodedMesh = nullptr;
+        GLuint decodedProgram = 0;
+
+        for(size_t i = 0; i < packets.size(); i++){
+            DrawPacket &p = packets[i];
+            if(p.program != currentProgram || p.pass != currentPass){
+                glUseProgram(p.program);
+                currentProgram = p.program;
+                stats.programBinds++;
+                // the subroutine uniforms are reset every time a Shader Program is made active
+                currentSubroutine = (GLuint)-1;
+            }
+            if(p.pass != currentPass){
+                currentPass = p.pass;
+                beginPass(p.pass);
+            }
+            // GL_INVALID_INDEX is used for the Shader Programs without subroutines
+            if(p.subroutine != currentSubroutine && p.subroutine != GL_INVALID_INDEX){
+                glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 1, &p.subroutine);
+                currentSubroutine = p.subroutine;
+                stats.subroutineBinds++;
+            }
+            if(p.mesh->VAO != currentVAO){
+                glBindVertexArray(p.mesh->VAO);
+                currentVAO = p.mesh->VAO;
+                stats.vaoBinds++;
+            }
+            if(p.object != nullptr)
+                p.object->SetUniforms(view, p.program);
+            // the uniforms to decode the vertex format are set only when the mesh changes (the VAO is bound only then)
+            if(decodedMesh != p.mesh || decodedProgram != p.program){
+                p.mesh->SetDecodeUniforms(p.program);
+                decodedMesh = p.mesh;
+                decodedProgram = p.program;
+            }
+            p.mesh->DrawBound(p.lod);
+            stats.drawCalls++;
+        }
+        glBindVertexArray(0);
+        stats.naiveBinds = stats.drawCalls * 4;
+    }
+
+    int BindsAvoided(){
+        return stats.naiveBinds - (stats.programBinds + stats.subroutineBinds + stats.vaoBinds + 1);
+    }
+
+private:
+    std::vector<DrawPacket> packets;
+    std::vector<DrawPacket> sorted;
+    float nearPlane, farPlane;
+    float pixelsPerUnitAtOne;
+};
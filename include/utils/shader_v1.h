@@ -9,6 +9,11 @@ author: Davide Gadia
 Real-Time Graphics Programming - a.a. 2020/2021
 Master degree in Computer Science
 Universita' degli Studi di Milano
+
+- the Shader Programs are loaded from the cache of the program binaries when possible (see programCache.h)
+- otherwise the shaders are compiled and linked without waiting for the result: with the parallel compilation (GL_KHR_parallel_shader_compile),
+  the driver compiles the programs in background threads: the application polls them with Ready, and Finish checks the errors and saves the binary in the cache
+  (Use calls Finish, for the programs not finished by the application)
 */
 
 #pragma once
@@ -21,12 +26,48 @@ using namespace std;
 #include <sstream>
 #include <iostream>
 
+#include <utils/programCache.h>
+
+// the extension for the parallel compilation is not included in the glad loader: its function is loaded by the application, and passed to Shader::Configure
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)(GLuint count);
+#endif
+
 /////////////////// SHADER class ///////////////////////
 class Shader
 {
 public:
     GLuint Program;
 
+    // settings shared by all the Shader Programs, and number of programs loaded from the cache and compiled since the start
+    struct Settings {
+        bool cache;
+        bool parallel;
+        uint64_t driverHash;
+        int loaded, compiled;
+    };
+
+    static Settings& Global()
+    {
+        static Settings settings = {false, false, 0, 0, 0};
+        return settings;
+    }
+
+    // it enables the cache of the program binaries (if the driver supports them), and the parallel compilation (if maxThreads is not null)
+    // it must be called after the creation of the context, before the creation of the Shader Programs
+    static void Configure(bool cache, PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxThreads)
+    {
+        Settings& settings = Global();
+        settings.cache = cache && ProgramCache::Supported();
+        settings.driverHash = ProgramCache::DriverHash();
+        settings.parallel = maxThreads != nullptr;
+        // the driver chooses the number of threads
+        if(maxThreads)
+            maxThreads(0xFFFFFFFF);
+    }
+
     //////////////////////////////////////////
 
     //constructor
@@ -62,49 +103,136 @@ public:
             cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
         }
 
-        // Convert strings to char pointers
-        const GLchar* vShaderCode = vertexCode.c_str();
-        const GLchar * fShaderCode = fragmentCode.c_str();
-
-        // Step 2: we compile the shaders
-        GLuint vertex, fragment;
+        // Step 2: we load the Shader Program from the cache, or we compile and link the shaders
+        const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER};
+        const string sources[] = {vertexCode, fragmentCode};
+        this->Build(2, types, sources, string(fragmentPath) + PROGRAM_CACHE_EXTENSION);
+    }
 
-        // Vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        // check compilation errors
-        checkCompileErrors(vertex, "VERTEX");
+    //////////////////////////////////////////
 
-        // Fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        // check compilation errors
-        checkCompileErrors(fragment, "FRAGMENT");
+    // constructor of a Shader Program with a single compute shader (OpenGL 4.3)
+    Shader(const GLchar* computePath)
+    {
+        string computeCode;
+        ifstream cShaderFile;
+        cShaderFile.exceptions (ifstream::failbit | ifstream::badbit);
+        try
+        {
+            cShaderFile.open(computePath);
+            stringstream cShaderStream;
+            cShaderStream << cShaderFile.rdbuf();
+            cShaderFile.close();
+            computeCode = cShaderStream.str();
+        }
+        catch (const ifstream::failure& e)
+        {
+            cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
+        }
+        const GLenum types[] = {GL_COMPUTE_SHADER};
+        this->Build(1, types, &computeCode, string(computePath) + PROGRAM_CACHE_EXTENSION);
+    }
 
-        // Step 3: Shader Program creation
-        this->Program = glCreateProgram();
-        glAttachShader(this->Program, vertex);
-        glAttachShader(this->Program, fragment);
-        glLinkProgram(this->Program);
-        // check linking errors
-        checkCompileErrors(this->Program, "PROGRAM");
+    //////////////////////////////////////////
 
-        // Step 4: we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+    // with the parallel compilation, it tells (without waiting) if the compilation and linking are completed; without it, the program is always ready
+    bool Ready() const
+    {
+        if(!this->pending || !Global().parallel)
+            return true;
+        GLint completed = GL_FALSE;
+        glGetProgramiv(this->Program, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
     }
 
-    //////////////////////////////////////////
+    // it checks the errors of the compilation and linking (waiting for their end), deletes the shaders, and saves the binary in the cache
+    void Finish()
+    {
+        if(!this->pending)
+            return;
+        this->pending = false;
+        for(int i = 0; i < this->stageCount; i++)
+            checkCompileErrors(this->stages[i], this->stageTypes[i] == GL_VERTEX_SHADER ? "VERTEX" : (this->stageTypes[i] == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE"));
+        checkCompileErrors(this->Program, "PROGRAM");
+        // we delete the shaders because they are linked to the Shader Program, and we do not need them anymore
+        for(int i = 0; i < this->stageCount; i++){
+            glDetachShader(this->Program, this->stages[i]);
+            glDeleteShader(this->stages[i]);
+        }
+        this->stageCount = 0;
+        GLint linked = GL_FALSE;
+        glGetProgramiv(this->Program, GL_LINK_STATUS, &linked);
+        if(linked == GL_TRUE && Global().cache)
+            ProgramCache::Save(this->cachePath, this->sourceHash, Global().driverHash, this->Program);
+    }
 
     // We activate the Shader Program as part of the current rendering process
-    void Use() { glUseProgram(this->Program); }
+    void Use()
+    {
+        this->Finish();
+        glUseProgram(this->Program);
+    }
 
     // We delete the Shader Program when application closes
-    void Delete() { glDeleteProgram(this->Program); }
+    void Delete()
+    {
+        for(int i = 0; i < this->stageCount; i++)
+            glDeleteShader(this->stages[i]);
+        this->stageCount = 0;
+        this->pending = false;
+        glDeleteProgram(this->Program);
+    }
 
 private:
+    // shaders waiting for the end of the compilation (they are checked and deleted by Finish)
+    GLuint stages[2];
+    GLenum stageTypes[2];
+    int stageCount;
+    bool pending;
+    // hash of the sources, and file of the cache of the program
+    uint64_t sourceHash;
+    string cachePath;
+
+    //////////////////////////////////////////
+
+    void Build(int count, const GLenum* types, const string* sources, const string& cachePath)
+    {
+        Settings& settings = Global();
+        this->stageCount = 0;
+        this->pending = false;
+        this->cachePath = cachePath;
+        this->sourceHash = ProgramCache::Hash("");
+        for(int i = 0; i < count; i++)
+            this->sourceHash = ProgramCache::Hash(sources[i] + '\0', this->sourceHash);
+
+        this->Program = glCreateProgram();
+        if(settings.cache){
+            if(ProgramCache::Load(cachePath, this->sourceHash, settings.driverHash, this->Program)){
+                settings.loaded++;
+                return;
+            }
+            // a program rejected by the driver is created again
+            glDeleteProgram(this->Program);
+            this->Program = glCreateProgram();
+            glProgramParameteri(this->Program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+
+        // we do not check the result of the compilation and linking here: with the parallel compilation, they are still running
+        for(int i = 0; i < count; i++){
+            const GLchar* code = sources[i].c_str();
+            GLuint shader = glCreateShader(types[i]);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(this->Program, shader);
+            this->stages[i] = shader;
+            this->stageTypes[i] = types[i];
+        }
+        this->stageCount = count;
+        glLinkProgram(this->Program);
+        this->pending = true;
+        settings.compiled++;
+    }
+
     //////////////////////////////////////////
 
     // Check compilation and linking errors
@@ -0,0 +1,700 @@
+/*
+TextRenderer class
+- UTF-8 strings are decoded in code points, and laid out with the kerning of the font
+- the glyphs are rendered by FreeType as Signed Distance Fields (SDF) in a single atlas texture: the printable ASCII glyphs are rendered at the start (on a worker thread, since it does not use OpenGL), the other ones the first time they are used
+- the shaping of each string (glyphs and their positions) is cached, and reused while the string is displayed
+- the strings of a frame are collected (AddText) in a single vertex buffer, with the color in the vertices, and drawn with a single draw call (Draw)
+
+Each texel of the SDF atlas stores the distance from the border of the glyph (0.5 on the border, > 0.5 inside), so the fragment shader can reconstruct sharp borders at any scale with a small atlas.
+The distances are computed with an exact Euclidean distance transform (Felzenszwalb & Huttenlocher) on a bitmap of the glyph rendered at higher resolution, and then sampled at the resolution of the atlas.
+
+The atlas is divided in cells of the same size, one for each glyph. Each glyph has a border as large as the range of the distances, so the bilinear filtering does not read the neighbouring glyphs.
+When all the cells are used, the cell of the least recently used glyph is reused (the glyphs used in the current frame are never evicted): the texture coordinates in the cached layouts are then recomputed, while their shaping is still valid.
+
+If the strings (and their positions and colors) of a frame are the same of the previous frame, the vertex buffer is not rebuilt nor uploaded.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <unordered_map>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <utils/textureStreamer.h>
+
+// size of the atlas, and of its cells
+#define TEXT_ATLAS_WIDTH 1024
+#define TEXT_ATLAS_HEIGHT 512
+#define TEXT_ATLAS_CELL 56
+// size (in pixels) of the glyphs in the atlas
+#define TEXT_SDF_SIZE 32
+// maximum distance (in texels of the atlas) stored in the SDF, used also as border around each glyph
+#define TEXT_SDF_SPREAD 4
+// the glyphs are rendered by FreeType at this multiple of the size in the atlas, to compute the distances
+#define TEXT_SDF_UPSCALE 4
+// the metrics of the glyphs are expressed at this size, so a scale of 1 corresponds to a 48 pixels font
+#define TEXT_REFERENCE_SIZE 48
+// the layouts not used for this number of frames are removed from the cache
+#define TEXT_LAYOUT_MAX_AGE 120
+// code point used for the invalid UTF-8 sequences
+#define TEXT_REPLACEMENT_CHARACTER 0xFFFD
+// value of the free cells of the atlas
+#define TEXT_NO_GLYPH 0xFFFFFFFFu
+
+enum textPosition{
+    TEXT_ALIGN_LEFT,
+    TEXT_ALIGN_CENTER,
+    TEXT_ALIGN_RIGHT,
+};
+
+struct GlyphInfo {
+    // index of the glyph in the font (used for the kerning)
+    FT_UInt index;
+    // size of the glyph quad (including the border of the SDF), and offset from the baseline to its left/top (in pixels, at the reference size)
+    glm::vec2 size;
+    glm::vec2 bearing;
+    // offset to the next glyph (in pixels, at the reference size)
+    float advance;
+    // rectangle of the glyph in the atlas (normalized texture coordinates)
+    glm::vec2 uvMin, uvMax;
+    // cell of the atlas (-1 for the glyphs without a bitmap, e.g. spaces), and last frame in which the glyph has been used
+    int cell;
+    unsigned int lastFrame;
+};
+
+// font and atlas with the preloaded glyphs, rendered on the CPU and waiting to be uploaded
+struct GlyphAtlas {
+    // the font remains open, to render the other glyphs when needed
+    FT_Library ft;
+    FT_Face face;
+    vector<unsigned char> pixels;
+    vector<std::pair<uint32_t, GlyphInfo> > glyphs;
+};
+
+// vertex of the quads of the glyphs
+struct TextVertex {
+    glm::vec2 position;
+    glm::vec2 texCoords;
+    glm::vec3 color;
+};
+
+// glyph of a shaped string, with its horizontal position (at the reference size, kerning included)
+struct ShapedGlyph {
+    uint32_t code;
+    float x;
+};
+
+// cached layout of a string
+struct TextLayout {
+    // result of the shaping: it depends only on the font
+    vector<ShapedGlyph> glyphs;
+    float width;
+    // quads relative to the position of the string (xy = position, zw = texture coordinates): they depend on the cells of the atlas
+    vector<glm::vec4> vertices;
+    // generation of the atlas used to compute the vertices
+    unsigned int generation;
+    // last frame in which the layout has been used
+    unsigned int lastFrame;
+};
+
+// string added in the frame
+struct TextItem {
+    const TextLayout* layout;
+    float x, y;
+    glm::vec3 color;
+
+    bool operator==(const TextItem& other) const
+    {
+        return layout == other.layout && x == other.x && y == other.y && color == other.color;
+    }
+};
+
+class TextRenderer
+{
+public:
+    // true when the atlas has been uploaded (before that, the text is not displayed)
+    bool loaded;
+    // quads drawn in the last frame, number of strings shaped (the others have been found in the cache), and of glyphs rendered and evicted from the atlas
+    size_t lastQuads;
+    size_t layoutsBuilt;
+    size_t glyphsRendered;
+    size_t glyphsEvicted;
+
+    TextRenderer(): loaded(false), lastQuads(0), layoutsBuilt(0), glyphsRendered(0), glyphsEvicted(0), ft(nullptr), face(nullptr), hasKerning(false),
+                    VAO(0), VBO(0), atlasTexture(0), capacity(0), uploaded(false), verticesChanged(false), generation(0), frame(0) {}
+
+    TextRenderer(const TextRenderer& copy) = delete;
+    TextRenderer& operator=(const TextRenderer& copy) = delete;
+
+    //////////////////////////////////////////
+    // it opens the font, and it renders the SDF of the printable ASCII glyphs in the first cells of the atlas
+    // it does not use OpenGL, so it can be executed on a worker thread
+    static bool RasterizeFont(const string& fontPath, GlyphAtlas& atlas)
+    {
+        if (FT_Init_FreeType(&atlas.ft))
+        {
+            std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
+            return false;
+        }
+        if (FT_New_Face(atlas.ft, fontPath.c_str(), 0, &atlas.face))
+        {
+            std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;
+            FT_Done_FreeType(atlas.ft);
+            return false;
+        }
+        FT_Set_Pixel_Sizes(atlas.face, 0, TEXT_SDF_SIZE * TEXT_SDF_UPSCALE);
+
+        atlas.pixels.assign((size_t)TEXT_ATLAS_WIDTH * TEXT_ATLAS_HEIGHT, 0);
+        int cell = 0;
+        for (uint32_t c = 32; c < 127; c++)
+        {
+            GlyphInfo g;
+            vector<unsigned char> sdf;
+            glm::ivec2 size;
+            if (!renderGlyph(atlas.face, c, g, sdf, size))
+                continue;
+            if (!sdf.empty())
+            {
+                g.cell = cell++;
+                copyToCell(sdf, size, g, &atlas.pixels[0], TEXT_ATLAS_WIDTH);
+            }
+            atlas.glyphs.push_back(std::make_pair(c, g));
+        }
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // creation of the vertex buffer of the text (it must be called once the OpenGL context is available)
+    void Init()
+    {
+        glGenVertexArrays(1, &this->VAO);
+        glGenBuffers(1, &this->VBO);
+        glBindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)offsetof(TextVertex, color));
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+    // creation of the atlas texture (on the main thread): its content is streamed (see textureStreamer.h)
+    // the renderer becomes the owner of the font
+    void SetAtlas(std::shared_ptr<GlyphAtlas> atlas, TextureStreamer& streamer)
+    {
+        this->ft = atlas->ft;
+        this->face = atlas->face;
+        this->hasKerning = FT_HAS_KERNING(this->face) != 0;
+        this->cells.assign(cellCount(), TEXT_NO_GLYPH);
+        for (size_t i = 0; i < atlas->glyphs.size(); i++)
+        {
+            this->glyphs[atlas->glyphs[i].first] = atlas->glyphs[i].second;
+            if (atlas->glyphs[i].second.cell >= 0)
+                this->cells[atlas->glyphs[i].second.cell] = atlas->glyphs[i].first;
+        }
+        this->glyphsRendered += atlas->glyphs.size();
+
+        glGenTextures(1, &this->atlasTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, this->atlasTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, TEXT_ATLAS_WIDTH, TEXT_ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        TextureUpload u;
+        u.texture = this->atlasTexture;
+        u.bindTarget = GL_TEXTURE_2D;
+        u.target = GL_TEXTURE_2D;
+        u.level = 0;
+        u.width = TEXT_ATLAS_WIDTH;
+        u.height = TEXT_ATLAS_HEIGHT;
+        u.format = GL_RED;
+        u.type = GL_UNSIGNED_BYTE;
+        u.bytesPerPixel = 1;
+        // the pointer keeps alive the atlas until the upload
+        u.pixels = std::shared_ptr<const unsigned char>(atlas, &atlas->pixels[0]);
+        u.onComplete = [this](){
+            this->loaded = true;
+        };
+        streamer.Enqueue(u);
+    }
+
+    void Release()
+    {
+        glDeleteTextures(1, &this->atlasTexture);
+        glDeleteBuffers(1, &this->VBO);
+        glDeleteVertexArrays(1, &this->VAO);
+        this->atlasTexture = this->VBO = this->VAO = 0;
+        if (this->face)
+            FT_Done_Face(this->face);
+        if (this->ft)
+            FT_Done_FreeType(this->ft);
+        this->face = nullptr;
+        this->ft = nullptr;
+        this->glyphs.clear();
+        this->layouts.clear();
+        this->items.clear();
+        this->drawnItems.clear();
+        this->loaded = false;
+    }
+
+    //////////////////////////////////////////
+    // code points of a UTF-8 string (the invalid sequences are replaced by U+FFFD)
+    static vector<uint32_t> DecodeUTF8(const string& text)
+    {
+        vector<uint32_t> codes;
+        size_t i = 0;
+        while (i < text.size())
+        {
+            unsigned char c = (unsigned char)text[i];
+            // length of the sequence, and bits of the first byte
+            int length = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 0;
+            if (length == 0 || i + length > text.size())
+            {
+                codes.push_back(TEXT_REPLACEMENT_CHARACTER);
+                i++;
+                continue;
+            }
+            uint32_t code = length == 1 ? c : c & (0x7F >> length);
+            bool valid = true;
+            for (int k = 1; k < length; k++)
+            {
+                unsigned char next = (unsigned char)text[i + k];
+                valid = valid && (next & 0xC0) == 0x80;
+                code = (code << 6) | (next & 0x3F);
+            }
+            // overlong encodings, surrogates and values outside the Unicode range are not valid
+            static const uint32_t minCode[5] = {0, 0, 0x80, 0x800, 0x10000};
+            valid = valid && code >= minCode[length] && code <= 0x10FFFF && (code < 0xD800 || code > 0xDFFF);
+            codes.push_back(valid ? code : TEXT_REPLACEMENT_CHARACTER);
+            i += valid ? length : 1;
+        }
+        return codes;
+    }
+
+    // it adds the string to the text of the frame, shaping it only if it is not in the cache
+    void AddText(const string& text, float x, float y, float scale, glm::vec3 color, textPosition alignment = TEXT_ALIGN_LEFT)
+    {
+        // until the atlas is available, the text is not displayed
+        if (!this->loaded)
+            return;
+        // the layout depends on the string, the scale and the alignment
+        string key = text;
+        key.push_back('\0');
+        key.append((const char*)&scale, sizeof(scale));
+        key.push_back((char)alignment);
+        std::unordered_map<string, TextLayout>::iterator it = this->layouts.find(key);
+        bool shaped = it != this->layouts.end();
+        if (!shaped)
+            it = this->layouts.insert(std::make_pair(key, TextLayout())).first;
+        TextLayout& layout = it->second;
+        layout.lastFrame = this->frame;
+        if (!shaped)
+        {
+            this->shape(text, layout);
+            this->layoutsBuilt++;
+        }
+        // the quads are computed again if a glyph has been moved in the atlas
+        if (!shaped || layout.generation != this->generation)
+        {
+            this->buildVertices(layout, scale, alignment);
+            this->verticesChanged = true;
+        }
+        TextItem item = { &layout, x, y, color };
+        this->items.push_back(item);
+    }
+
+    //////////////////////////////////////////
+    // it draws all the text added in the frame with a single draw call, and it prepares the next frame
+    void Draw(GLuint program, GLenum textureUnit)
+    {
+        this->lastQuads = 0;
+        // the vertices are rebuilt and uploaded only if the text changed from the previous frame
+        bool changed = this->verticesChanged || this->items != this->drawnItems;
+        if (changed)
+        {
+            this->vertices.clear();
+            for (size_t i = 0; i < this->items.size(); i++)
+            {
+                const TextItem& item = this->items[i];
+                const vector<glm::vec4>& v = item.layout->vertices;
+                for (size_t k = 0; k < v.size(); k++)
+                {
+                    TextVertex vertex = { glm::vec2(v[k].x + item.x, v[k].y + item.y), glm::vec2(v[k].z, v[k].w), item.color };
+                    this->vertices.push_back(vertex);
+                }
+            }
+        }
+
+        if (this->loaded && !this->vertices.empty())
+        {
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "text"), textureUnit - GL_TEXTURE0);
+            glActiveTexture(textureUnit);
+            glBindTexture(GL_TEXTURE_2D, this->atlasTexture);
+            glBindVertexArray(this->VAO);
+            if (changed || !this->uploaded)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+                // the buffer grows when needed, otherwise it is orphaned, so we do not wait for the draw of the previous frame
+                size_t bytes = this->vertices.size() * sizeof(TextVertex);
+                if (bytes > this->capacity)
+                    this->capacity = std::max(bytes, 2 * this->capacity);
+                glBufferData(GL_ARRAY_BUFFER, this->capacity, NULL, GL_STREAM_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &this->vertices[0]);
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                this->uploaded = true;
+            }
+            glDrawArrays(GL_TRIANGLES, 0, (GLsizei)this->vertices.size());
+            glBindVertexArray(0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            this->lastQuads = this->vertices.size() / 6;
+        }
+        else if (changed)
+            this->uploaded = false;
+
+        // the layouts of the strings not displayed for a while are removed
+        this->frame++;
+        if (this->frame % TEXT_LAYOUT_MAX_AGE == 0)
+            for (std::unordered_map<string, TextLayout>::iterator it = this->layouts.begin(); it != this->layouts.end(); )
+            {
+                if (this->frame - it->second.lastFrame > TEXT_LAYOUT_MAX_AGE)
+                {
+                    // the items of the last frame must not point to a removed layout
+                    this->drawnItems.clear();
+                    it = this->layouts.erase(it);
+                }
+                else
+                    it++;
+            }
+        if (changed)
+            this->drawnItems.swap(this->items);
+        this->items.clear();
+        this->verticesChanged = false;
+    }
+
+private:
+    FT_Library ft;
+    FT_Face face;
+    bool hasKerning;
+    // glyphs rendered so far, and code point of the glyph in each cell of the atlas
+    std::unordered_map<uint32_t, GlyphInfo> glyphs;
+    vector<uint32_t> cells;
+    GLuint VAO, VBO;
+    GLuint atlasTexture;
+    size_t capacity;
+    // vertices in the buffer, and strings used to build them
+    vector<TextVertex> vertices;
+    vector<TextItem> drawnItems;
+    bool uploaded;
+    // strings of the current frame, and true if the vertices of one of their layouts have been recomputed
+    vector<TextItem> items;
+    bool verticesChanged;
+    std::unordered_map<string, TextLayout> layouts;
+    // incremented every time a cell of the atlas is reused
+    unsigned int generation;
+    unsigned int frame;
+
+    static int cellCount()
+    {
+        return (TEXT_ATLAS_WIDTH / TEXT_ATLAS_CELL) * (TEXT_ATLAS_HEIGHT / TEXT_ATLAS_CELL);
+    }
+
+    //////////////////////////////////////////
+    // it finds the glyphs of the string, and their positions with the kerning
+    void shape(const string& text, TextLayout& layout)
+    {
+        vector<uint32_t> codes = DecodeUTF8(text);
+        const float toReference = (float)TEXT_REFERENCE_SIZE / (TEXT_SDF_SIZE * TEXT_SDF_UPSCALE);
+        float x = 0.0f;
+        FT_UInt previous = 0;
+        layout.glyphs.clear();
+        for (size_t i = 0; i < codes.size(); i++)
+        {
+            const GlyphInfo* g = this->glyph(codes[i]);
+            if (g == nullptr)
+                continue;
+            if (this->hasKerning && previous != 0 && g->index != 0)
+            {
+                FT_Vector delta;
+                // the kerning is in 1/64 pixels, at the size of the font used to render the glyphs
+                if (FT_Get_Kerning(this->face, previous, g->index, FT_KERNING_DEFAULT, &delta) == 0)
+                    x += delta.x / 64.0f * toReference;
+            }
+            ShapedGlyph shaped = { codes[i], x };
+            layout.glyphs.push_back(shaped);
+            x += g->advance;
+            previous = g->index;
+        }
+        layout.width = x;
+    }
+
+    // it computes the quads of the glyphs of the string, relative to the position of the string
+    void buildVertices(TextLayout& layout, float scale, textPosition alignment)
+    {
+        float x0 = 0.0f;
+        if (alignment == TEXT_ALIGN_CENTER)
+            x0 -= layout.width * scale / 2;
+        else if (alignment == TEXT_ALIGN_RIGHT)
+            x0 -= layout.width * scale;
+
+        layout.vertices.clear();
+        for (size_t i = 0; i < layout.glyphs.size(); i++)
+        {
+            // the glyph may have been evicted from the atlas: in this case, it is rendered again
+            const GlyphInfo* g = this->glyph(layout.glyphs[i].code);
+            // the glyphs without a bitmap (e.g. spaces), or not fitting in the atlas, have no quad
+            if (g == nullptr || g->cell < 0)
+                continue;
+            const GlyphInfo &ch = *g;
+            float xpos = x0 + (layout.glyphs[i].x + ch.bearing.x) * scale;
+            float ypos = -(ch.size.y - ch.bearing.y) * scale;
+            float w = ch.size.x * scale;
+            float h = ch.size.y * scale;
+            glm::vec4 quad[6] = {
+                glm::vec4(xpos,     ypos + h, ch.uvMin.x, ch.uvMin.y),
+                glm::vec4(xpos,     ypos,     ch.uvMin.x, ch.uvMax.y),
+                glm::vec4(xpos + w, ypos,     ch.uvMax.x, ch.uvMax.y),
+
+                glm::vec4(xpos,     ypos + h, ch.uvMin.x, ch.uvMin.y),
+                glm::vec4(xpos + w, ypos,     ch.uvMax.x, ch.uvMax.y),
+                glm::vec4(xpos + w, ypos + h, ch.uvMax.x, ch.uvMin.y)
+            };
+            layout.vertices.insert(layout.vertices.end(), quad, quad + 6);
+        }
+        // the glyphs of this layout have been used in this frame, so they have not been evicted while computing the quads
+        layout.generation = this->generation;
+    }
+
+    //////////////////////////////////////////
+    // glyph of the code point: if it is not in the atlas, it is rendered and uploaded in a cell
+    const GlyphInfo* glyph(uint32_t code)
+    {
+        std::unordered_map<uint32_t, GlyphInfo>::iterator it = this->glyphs.find(code);
+        if (it != this->glyphs.end())
+        {
+            it->second.lastFrame = this->frame;
+            return &it->second;
+        }
+
+        GlyphInfo g;
+        vector<unsigned char> sdf;
+        glm::ivec2 size;
+        if (this->face == nullptr || !renderGlyph(this->face, code, g, sdf, size))
+            return nullptr;
+        if (!sdf.empty())
+        {
+            g.cell = this->allocateCell();
+            // all the cells contain glyphs of the current frame
+            if (g.cell < 0)
+                return nullptr;
+            vector<unsigned char> pixels((size_t)TEXT_ATLAS_CELL * TEXT_ATLAS_CELL, 0);
+            glm::ivec2 cellPos = cellPosition(g.cell);
+            copyToCell(sdf, size, g, &pixels[0], TEXT_ATLAS_CELL, cellPos);
+            // the cell is small, so it is uploaded directly
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, this->atlasTexture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, cellPos.x, cellPos.y, TEXT_ATLAS_CELL, TEXT_ATLAS_CELL, GL_RED, GL_UNSIGNED_BYTE, &pixels[0]);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            this->cells[g.cell] = code;
+        }
+        g.lastFrame = this->frame;
+        this->glyphsRendered++;
+        return &(this->glyphs[code] = g);
+    }
+
+    // a free cell of the atlas or, if the atlas is full, the cell of the least recently used glyph (-1 if all the glyphs are used in this frame)
+    int allocateCell()
+    {
+        for (size_t i = 0; i < this->cells.size(); i++)
+            if (this->cells[i] == TEXT_NO_GLYPH)
+                return (int)i;
+
+        // the glyphs are used also by the cached layouts of the strings still displayed (they are not looked up every frame)
+        for (std::unordered_map<string, TextLayout>::iterator it = this->layouts.begin(); it != this->layouts.end(); it++)
+            for (size_t k = 0; k < it->second.glyphs.size(); k++)
+            {
+                std::unordered_map<uint32_t, GlyphInfo>::iterator g = this->glyphs.find(it->second.glyphs[k].code);
+                if (g != this->glyphs.end())
+                    g->second.lastFrame = std::max(g->second.lastFrame, it->second.lastFrame);
+            }
+        int victim = -1;
+        unsigned int oldest = this->frame;
+        for (size_t i = 0; i < this->cells.size(); i++)
+        {
+            unsigned int lastFrame = this->glyphs[this->cells[i]].lastFrame;
+            if (lastFrame < oldest)
+            {
+                oldest = lastFrame;
+                victim = (int)i;
+            }
+        }
+        if (victim < 0)
+            return -1;
+        this->glyphs.erase(this->cells[victim]);
+        this->cells[victim] = TEXT_NO_GLYPH;
+        // the quads of the cached layouts may refer to the evicted glyph
+        this->generation++;
+        this->glyphsEvicted++;
+        return victim;
+    }
+
+    static glm::ivec2 cellPosition(int cell)
+    {
+        int columns = TEXT_ATLAS_WIDTH / TEXT_ATLAS_CELL;
+        return glm::ivec2(cell % columns, cell / columns) * TEXT_ATLAS_CELL;
+    }
+
+    // it copies the SDF of the glyph in its cell (in an image with the given width, whose origin is at the given position of the atlas), and it sets the texture coordinates
+    // the glyphs larger than a cell are cropped
+    static void copyToCell(const vector<unsigned char>& sdf, glm::ivec2 size, GlyphInfo& g, unsigned char* image, int imageWidth, glm::ivec2 imageOrigin = glm::ivec2(0))
+    {
+        glm::ivec2 p = cellPosition(g.cell);
+        int w = std::min(size.x, TEXT_ATLAS_CELL), h = std::min(size.y, TEXT_ATLAS_CELL);
+        for (int r = 0; r < h; r++)
+            memcpy(image + (size_t)(p.y - imageOrigin.y + r) * imageWidth + p.x - imageOrigin.x, &sdf[(size_t)r * size.x], w);
+        g.uvMin = glm::vec2(p) / glm::vec2(TEXT_ATLAS_WIDTH, TEXT_ATLAS_HEIGHT);
+        g.uvMax = glm::vec2(p + glm::ivec2(w, h)) / glm::vec2(TEXT_ATLAS_WIDTH, TEXT_ATLAS_HEIGHT);
+        g.size *= glm::vec2(w, h) / glm::vec2(size);
+    }
+
+    // it renders the SDF of a glyph (empty for the glyphs without a bitmap, e.g. spaces)
+    static bool renderGlyph(FT_Face face, uint32_t code, GlyphInfo& g, vector<unsigned char>& sdf, glm::ivec2& size)
+    {
+        // the code points not available in the font are rendered with the "missing glyph" of the font (index 0)
+        FT_UInt index = FT_Get_Char_Index(face, code);
+        if (FT_Load_Glyph(face, index, FT_LOAD_RENDER))
+        {
+            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
+            return false;
+        }
+        // from the pixels of the atlas to the pixels of the reference size
+        const float toReference = (float)TEXT_REFERENCE_SIZE / TEXT_SDF_SIZE;
+        FT_Bitmap &bm = face->glyph->bitmap;
+        g.index = index;
+        g.cell = -1;
+        g.lastFrame = 0;
+        g.size = g.bearing = g.uvMin = g.uvMax = glm::vec2(0.0f);
+        // advance is number of 1/64 pixels
+        g.advance = face->glyph->advance.x / 64.0f / TEXT_SDF_UPSCALE * toReference;
+        sdf.clear();
+        size = glm::ivec2(0);
+        if (bm.width == 0 || bm.rows == 0)
+            return true;
+        size = computeSDF(bm, sdf);
+        g.size = glm::vec2(size) * toReference;
+        g.bearing = (glm::vec2(face->glyph->bitmap_left, face->glyph->bitmap_top) / (float)TEXT_SDF_UPSCALE
+                     + glm::vec2(-TEXT_SDF_SPREAD, TEXT_SDF_SPREAD)) * toReference;
+        return true;
+    }
+
+    //////////////////////////////////////////
+    // Signed Distance Field of a glyph rendered by FreeType at TEXT_SDF_UPSCALE times the size in the atlas
+    // it returns the size of the SDF (the size of the glyph in the atlas, plus the border)
+    static glm::ivec2 computeSDF(const FT_Bitmap& bm, vector<unsigned char>& sdf)
+    {
+        const int up = TEXT_SDF_UPSCALE;
+        const int border = TEXT_SDF_SPREAD * up;
+        glm::ivec2 size((bm.width + up - 1) / up + 2 * TEXT_SDF_SPREAD, (bm.rows + up - 1) / up + 2 * TEXT_SDF_SPREAD);
+        int w = size.x * up, h = size.y * up;
+
+        // squared distance from the closest texel inside (outside) the glyph, for the texels outside (inside)
+        const float inf = 1e20f;
+        vector<float> outside((size_t)w * h), inside((size_t)w * h);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+            {
+                int bx = x - border, by = y - border;
+                bool in = bx >= 0 && by >= 0 && bx < (int)bm.width && by < (int)bm.rows && bm.buffer[by * bm.pitch + bx] >= 128;
+                outside[(size_t)y * w + x] = in ? 0.0f : inf;
+                inside[(size_t)y * w + x] = in ? inf : 0.0f;
+            }
+        distanceTransform(outside, w, h);
+        distanceTransform(inside, w, h);
+
+        // we sample the distances at the center of the texels of the atlas
+        sdf.resize((size_t)size.x * size.y);
+        for (int y = 0; y < size.y; y++)
+            for (int x = 0; x < size.x; x++)
+            {
+                size_t i = (size_t)(y * up + up / 2) * w + x * up + up / 2;
+                float d = (std::sqrt(outside[i]) - std::sqrt(inside[i])) / up;
+                float v = 0.5f - d / (2.0f * TEXT_SDF_SPREAD);
+                sdf[(size_t)y * size.x + x] = (unsigned char)(std::max(0.0f, std::min(1.0f, v)) * 255.0f + 0.5f);
+            }
+        return size;
+    }
+
+    // 2D squared Euclidean distance transform, as 1D transforms on the columns and then on the rows
+    static void distanceTransform(vector<float>& grid, int w, int h)
+    {
+        int n = std::max(w, h);
+        vector<float> f(n), d(n), z(n + 1);
+        vector<int> v(n);
+        for (int x = 0; x < w; x++)
+        {
+            for (int y = 0; y < h; y++)
+                f[y] = grid[(size_t)y * w + x];
+            distanceTransform1D(f, h, d, v, z);
+            for (int y = 0; y < h; y++)
+                grid[(size_t)y * w + x] = d[y];
+        }
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+                f[x] = grid[(size_t)y * w + x];
+            distanceTransform1D(f, w, d, v, z);
+            for (int x = 0; x < w; x++)
+                grid[(size_t)y * w + x] = d[x];
+        }
+    }
+
+    // lower envelope of the parabolas rooted in each sample (Felzenszwalb & Huttenlocher)
+    static void distanceTransform1D(const vector<float>& f, int n, vector<float>& d, vector<int>& v, vector<float>& z)
+    {
+        int k = 0;
+        v[0] = 0;
+        z[0] = -1e20f;
+        z[1] = 1e20f;
+        for (int q = 1; q < n; q++)
+        {
+            float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            while (s <= z[k])
+            {
+                k--;
+                s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+            }
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = 1e20f;
+        }
+        k = 0;
+        for (int q = 0; q < n; q++)
+        {
+            while (z[k + 1] < q)
+                k++;
+            d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+        }
+    }
+};
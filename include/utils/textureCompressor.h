@@ -0,0 +1,331 @@
+/*
+Texture compression
+- BC7 encoder (BPTC, core in OpenGL 4.2): each block of 4x4 texels is stored in 16 bytes (8 bits per texel, instead of the 24/32 bits of RGB8/RGBA8)
+- generation of the mipmap chain
+- reading and writing of KTX 1.1 files (https://registry.khronos.org/KTX/specs/1.0/ktxspec_v1.html), containing all the mip levels (and the 6 faces of a cube map) ready to be uploaded with glCompressedTexImage2D
+
+The encoder uses only the mode 6 of BC7 (a single pair of RGBA endpoints with 7 bits per channel plus a shared bit, and 16 interpolation weights): it is fast and it gives a good quality for the smooth images of the environment maps.
+The endpoints are found along the principal axis of the colors of the block, and they are quantized choosing the shared bits with the lower error.
+
+The compression is done offline (see work/texcompress), the application only reads the KTX file.
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// compressed texture with all its mip levels (and faces, for a cube map)
+struct CompressedTexture {
+    GLenum internalFormat;
+    int width, height;
+    int faces, levels;
+    // the images are stored level by level, and inside each level face by face
+    vector<vector<unsigned char> > images;
+
+    const vector<unsigned char>& Image(int level, int face) const
+    {
+        return images[level * faces + face];
+    }
+};
+
+class TextureCompressor
+{
+public:
+    //////////////////////////////////////////
+    // it compresses in BC7 an image with 3 (RGB) or 4 (RGBA) channels
+    static vector<unsigned char> CompressBC7(const unsigned char* pixels, int width, int height, int channels)
+    {
+        int bw = (width + 3) / 4, bh = (height + 3) / 4;
+        vector<unsigned char> out((size_t)bw * bh * 16);
+        unsigned char block[64];
+        for(int by = 0; by < bh; by++)
+            for(int bx = 0; bx < bw; bx++){
+                // the texels outside the image (for sizes not multiple of 4) replicate the border
+                for(int y = 0; y < 4; y++)
+                    for(int x = 0; x < 4; x++){
+                        int px = std::min(bx * 4 + x, width - 1), py = std::min(by * 4 + y, height - 1);
+                        const unsigned char* src = pixels + ((size_t)py * width + px) * channels;
+                        unsigned char* dst = block + (y * 4 + x) * 4;
+                        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2];
+                        dst[3] = channels == 4 ? src[3] : 255;
+                    }
+                EncodeBC7Block(block, &out[((size_t)by * bw + bx) * 16]);
+            }
+        return out;
+    }
+
+    // next level of the mipmap chain (2x2 box filter)
+    static vector<unsigned char> Downsample(const unsigned char* pixels, int width, int height, int channels, int& newWidth, int& newHeight)
+    {
+        newWidth = std::max(1, width / 2);
+        newHeight = std::max(1, height / 2);
+        vector<unsigned char> out((size_t)newWidth * newHeight * channels);
+        for(int y = 0; y < newHeight; y++)
+            for(int x = 0; x < newWidth; x++)
+                for(int c = 0; c < channels; c++){
+                    int x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+                    int y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+                    int sum = pixels[((size_t)y0 * width + x0) * channels + c] + pixels[((size_t)y0 * width + x1) * channels + c]
+                            + pixels[((size_t)y1 * width + x0) * channels + c] + pixels[((size_t)y1 * width + x1) * channels + c];
+                    out[((size_t)y * newWidth + x) * channels + c] = (unsigned char)((sum + 2) / 4);
+                }
+        return out;
+    }
+
+    static int MipLevels(int width, int height)
+    {
+        int levels = 1;
+        while(width > 1 || height > 1){
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            levels++;
+        }
+        return levels;
+    }
+
+    //////////////////////////////////////////
+    // encoding of a block of 4x4 RGBA texels in BC7 mode 6
+    static void EncodeBC7Block(const unsigned char* rgba, unsigned char* out)
+    {
+        // mean and principal axis (power iteration on the covariance matrix) of the colors
+        float mean[4] = {0, 0, 0, 0};
+        for(int i = 0; i < 16; i++)
+            for(int c = 0; c < 4; c++)
+                mean[c] += rgba[i * 4 + c] / 16.0f;
+        float cov[4][4] = {{0}};
+        for(int i = 0; i < 16; i++)
+            for(int a = 0; a < 4; a++)
+                for(int b = 0; b < 4; b++)
+                    cov[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+        float axis[4] = {1, 1, 1, 0};
+        for(int it = 0; it < 8; it++){
+            float next[4] = {0, 0, 0, 0};
+            for(int a = 0; a < 4; a++)
+                for(int b = 0; b < 4; b++)
+                    next[a] += cov[a][b] * axis[b];
+            float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+            if(len < 1e-6f)
+                break;
+            for(int c = 0; c < 4; c++)
+                axis[c] = next[c] / len;
+        }
+
+        // the endpoints are the extreme projections of the colors on the axis
+        float minT = 1e30f, maxT = -1e30f;
+        for(int i = 0; i < 16; i++){
+            float t = 0.0f;
+            for(int c = 0; c < 4; c++)
+                t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+        float e[2][4];
+        for(int c = 0; c < 4; c++){
+            e[0][c] = mean[c] + axis[c] * minT;
+            e[1][c] = mean[c] + axis[c] * maxT;
+        }
+
+        // quantization of the endpoints: 7 bits per channel, plus a bit shared by the 4 channels
+        // in an opaque block, the shared bits must be 1, otherwise the alpha of the endpoints (254 at most) would not be exactly 255
+        bool opaque = true;
+        for(int i = 0; i < 16; i++)
+            opaque = opaque && rgba[i * 4 + 3] == 255;
+        int q[2][4], p[2];
+        for(int k = 0; k < 2; k++){
+            float bestError = 1e30f;
+            for(int pbit = opaque ? 1 : 0; pbit < 2; pbit++){
+                int cand[4];
+                float error = 0.0f;
+                for(int c = 0; c < 4; c++){
+                    int v = (int)std::floor((e[k][c] - pbit) / 2.0f + 0.5f);
+                    cand[c] = std::max(0, std::min(127, v));
+                    float d = ((cand[c] << 1) | pbit) - e[k][c];
+                    error += d * d;
+                }
+                if(error < bestError){
+                    bestError = error;
+                    p[k] = pbit;
+                    for(int c = 0; c < 4; c++)
+                        q[k][c] = cand[c];
+                }
+            }
+        }
+
+        // for each texel, the closest of the 16 interpolated colors
+        int indices[16];
+        computeIndices(rgba, q, p, indices);
+        // the most significant bit of the index of the first texel is implicitly 0: otherwise, we swap the endpoints
+        if(indices[0] & 8){
+            for(int c = 0; c < 4; c++)
+                std::swap(q[0][c], q[1][c]);
+            std::swap(p[0], p[1]);
+            for(int i = 0; i < 16; i++)
+                indices[i] = 15 - indices[i];
+        }
+
+        // bits are written from the least significant bit of the first byte
+        memset(out, 0, 16);
+        int bit = 0;
+        writeBits(out, bit, 1 << 6, 7);
+        for(int c = 0; c < 4; c++){
+            writeBits(out, bit, q[0][c], 7);
+            writeBits(out, bit, q[1][c], 7);
+        }
+        writeBits(out, bit, p[0], 1);
+        writeBits(out, bit, p[1], 1);
+        for(int i = 0; i < 16; i++)
+            writeBits(out, bit, indices[i], i == 0 ? 3 : 4);
+    }
+
+    // decoding of a block in BC7 mode 6 (used to verify the encoder)
+    static void DecodeBC7Block(const unsigned char* in, unsigned char* rgba)
+    {
+        int bit = 7;
+        int q[2][4], p[2], indices[16];
+        for(int c = 0; c < 4; c++){
+            q[0][c] = readBits(in, bit, 7);
+            q[1][c] = readBits(in, bit, 7);
+        }
+        p[0] = readBits(in, bit, 1);
+        p[1] = readBits(in, bit, 1);
+        for(int i = 0; i < 16; i++)
+            indices[i] = readBits(in, bit, i == 0 ? 3 : 4);
+        for(int i = 0; i < 16; i++)
+            interpolate(q, p, indices[i], rgba + i * 4);
+    }
+
+    //////////////////////////////////////////
+    // KTX 1.1 files
+    static bool WriteKTX(const string& path, const CompressedTexture& tex)
+    {
+        ofstream file(path.c_str(), ios::binary | ios::trunc);
+        if(!file)
+            return false;
+        file.write((const char*)ktxIdentifier(), 12);
+        uint32_t header[13] = {
+            0x04030201,             // endianness
+            0, 1, 0,                // glType, glTypeSize, glFormat (0 for compressed formats)
+            tex.internalFormat,
+            GL_RGBA,                // glBaseInternalFormat
+            (uint32_t)tex.width, (uint32_t)tex.height, 0,
+            0,                      // numberOfArrayElements
+            (uint32_t)tex.faces,
+            (uint32_t)tex.levels,
+            0                       // bytesOfKeyValueData
+        };
+        file.write((const char*)header, sizeof(header));
+        for(int l = 0; l < tex.levels; l++){
+            // for a (not array) cube map, imageSize is the size of a single face
+            uint32_t imageSize = (uint32_t)tex.Image(l, 0).size();
+            file.write((const char*)&imageSize, 4);
+            // the compressed blocks are 16 bytes, so no padding is needed
+            for(int f = 0; f < tex.faces; f++)
+                file.write((const char*)&tex.Image(l, f)[0], tex.Image(l, f).size());
+        }
+        return (bool)file;
+    }
+
+    static bool ReadKTX(const string& path, CompressedTexture& tex)
+    {
+        ifstream file(path.c_str(), ios::binary);
+        if(!file)
+            return false;
+        unsigned char identifier[12];
+        uint32_t header[13];
+        if(!file.read((char*)identifier, 12) || memcmp(identifier, ktxIdentifier(), 12) != 0)
+            return false;
+        if(!file.read((char*)header, sizeof(header)) || header[0] != 0x04030201 || header[1] != 0 || header[3] != 0)
+            return false;
+        tex.internalFormat = header[4];
+        tex.width = header[6];
+        tex.height = header[7];
+        tex.faces = header[10];
+        tex.levels = std::max(1u, header[11]);
+        // the file must contain the levels it claims, each one with the size of its 16 byte blocks (a stale or wrong file is rejected, and the source images are used)
+        if((tex.faces != 1 && tex.faces != 6) || tex.width <= 0 || tex.height <= 0 || tex.levels > MipLevels(tex.width, tex.height))
+            return false;
+        file.seekg(header[12], ios::cur);
+        tex.images.assign(tex.levels * tex.faces, vector<unsigned char>());
+        for(int l = 0; l < tex.levels; l++){
+            uint32_t imageSize;
+            if(!file.read((char*)&imageSize, 4))
+                return false;
+            uint32_t w = std::max(1, tex.width >> l), h = std::max(1, tex.height >> l);
+            if(imageSize != ((w + 3) / 4) * ((h + 3) / 4) * 16)
+                return false;
+            for(int f = 0; f < tex.faces; f++){
+                vector<unsigned char>& image = tex.images[l * tex.faces + f];
+                image.resize(imageSize);
+                if(imageSize == 0 || !file.read((char*)&image[0], imageSize))
+                    return false;
+                // padding of the faces of the cube maps, and of the mip levels, to 4 bytes
+                file.seekg((4 - imageSize % 4) % 4, ios::cur);
+            }
+        }
+        return true;
+    }
+
+private:
+    static const unsigned char* ktxIdentifier()
+    {
+        static const unsigned char id[12] = {0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'};
+        return id;
+    }
+
+    static void interpolate(int q[2][4], int p[2], int index, unsigned char* color)
+    {
+        static const int weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        for(int c = 0; c < 4; c++){
+            int e0 = (q[0][c] << 1) | p[0], e1 = (q[1][c] << 1) | p[1];
+            color[c] = (unsigned char)(((64 - weights[index]) * e0 + weights[index] * e1 + 32) >> 6);
+        }
+    }
+
+    static void computeIndices(const unsigned char* rgba, int q[2][4], int p[2], int* indices)
+    {
+        unsigned char palette[16][4];
+        for(int k = 0; k < 16; k++)
+            interpolate(q, p, k, palette[k]);
+        for(int i = 0; i < 16; i++){
+            int best = 0, bestError = 1 << 30;
+            for(int k = 0; k < 16; k++){
+                int error = 0;
+                for(int c = 0; c < 4; c++){
+                    int d = rgba[i * 4 + c] - palette[k][c];
+                    error += d * d;
+                }
+                if(error < bestError){
+                    bestError = error;
+                    best = k;
+                }
+            }
+            indices[i] = best;
+        }
+    }
+
+    static void writeBits(unsigned char* out, int& bit, int value, int count)
+    {
+        for(int i = 0; i < count; i++, bit++)
+            if(value & (1 << i))
+                out[bit >> 3] |= (unsigned char)(1 << (bit & 7));
+    }
+
+    static int readBits(const unsigned char* in, int& bit, int count)
+    {
+        int value = 0;
+        for(int i = 0; i < count; i++, bit++)
+            if(in[bit >> 3] & (1 << (bit & 7)))
+                value |= 1 << i;
+        return value;
+    }
+};
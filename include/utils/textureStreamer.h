@@ -0,0 +1,223 @@
+/*
+TextureStreamer class
+- asynchronous upload of texture data through a ring of Pixel Buffer Objects (PBO)
+- the data decoded on the CPU (e.g., by the worker threads of the JobSystem) are enqueued, and uploaded by the main thread calling Update once per frame, within a budget of bytes per frame
+
+For each upload, the rows of the image are copied in a free slot of the ring, and glTexSubImage2D reads them from the PBO: the copy from the PBO to the texture is executed asynchronously by the driver, without stalling the application.
+Small uploads (e.g., the glyphs of a font) share the same slot. A fence is inserted after the commands using a slot: the slot is reused only when the fence has been signaled, and if no slot is free, the upload continues in the next frame (the application never waits for the GPU).
+
+With OpenGL 4.4, the buffer of the ring is persistently mapped (glBufferStorage), otherwise each slot is mapped (unsynchronized, since the fences already guarantee that the GPU is not reading it) before the copy.
+
+Images larger than a slot are uploaded in more steps, a block of rows at a time. The textures must be already allocated (e.g., with glTexImage2D and NULL data).
+*/
+
+#pragma once
+
+using namespace std;
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <cstring>
+#include <algorithm>
+
+#include <glad/glad.h>
+
+// size in bytes of each slot of the ring, and number of slots
+#define TEXTURE_STREAMER_SLOT_SIZE ((size_t)2 * 1024 * 1024)
+#define TEXTURE_STREAMER_SLOTS 4
+// maximum number of bytes uploaded in a frame
+#define TEXTURE_STREAMER_FRAME_BUDGET ((size_t)4 * 1024 * 1024)
+
+// a region of a texture to upload (tightly packed rows)
+struct TextureUpload {
+    GLuint texture;
+    // target used to bind the texture (e.g. GL_TEXTURE_CUBE_MAP), and target of the upload (e.g. GL_TEXTURE_CUBE_MAP_POSITIVE_X)
+    GLenum bindTarget;
+    GLenum target;
+    GLint level;
+    GLsizei width, height;
+    GLenum format, type;
+    GLsizei bytesPerPixel;
+    std::shared_ptr<const unsigned char> pixels;
+    // called on the main thread when the last rows have been submitted to OpenGL (the following draws will see the data)
+    std::function<void()> onComplete;
+    // rows already uploaded
+    GLsizei uploadedRows;
+};
+
+class TextureStreamer
+{
+public:
+    // statistics about the uploads
+    size_t uploadedBytes;
+    int stalledFrames;
+
+    TextureStreamer(): uploadedBytes(0), stalledFrames(0), pbo(0), mapped(nullptr), persistent(false), nextSlot(0) {}
+
+    TextureStreamer(const TextureStreamer& copy) = delete;
+    TextureStreamer& operator=(const TextureStreamer& copy) = delete;
+
+    // it creates the ring of PBOs: it must be called once the OpenGL context is available
+    void Init()
+    {
+        glGenBuffers(1, &this->pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+        GLsizeiptr size = (GLsizeiptr)TEXTURE_STREAMER_SLOT_SIZE * TEXTURE_STREAMER_SLOTS;
+        this->persistent = GLAD_GL_VERSION_4_4 != 0;
+        if(this->persistent)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+            this->mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        }
+        else
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        this->fences.assign(TEXTURE_STREAMER_SLOTS, (GLsync)0);
+    }
+
+    void Release()
+    {
+        for(size_t i = 0; i < this->fences.size(); i++)
+            if(this->fences[i])
+                glDeleteSync(this->fences[i]);
+        this->fences.clear();
+        if(this->pbo)
+        {
+            if(this->persistent)
+            {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glDeleteBuffers(1, &this->pbo);
+        }
+        this->pbo = 0;
+        this->mapped = nullptr;
+    }
+
+    void Enqueue(TextureUpload upload)
+    {
+        upload.uploadedRows = 0;
+        if(upload.width <= 0 || upload.height <= 0 || !upload.pixels)
+        {
+            if(upload.onComplete)
+                upload.onComplete();
+            return;
+        }
+        this->queue.push_back(upload);
+    }
+
+    // uploads to do (or in progress)
+    bool Idle()
+    {
+        return this->queue.empty();
+    }
+
+    //////////////////////////////////////////
+    // it uploads the enqueued data, until the budget is reached or there are no free slots
+    // it returns the number of bytes uploaded in this call
+    size_t Update(size_t budget = TEXTURE_STREAMER_FRAME_BUDGET)
+    {
+        if(this->queue.empty() || !this->pbo)
+            return 0;
+        size_t frameBytes = 0;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->pbo);
+        // the rows in the slots are tightly packed
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glActiveTexture(GL_TEXTURE0);
+
+        // slot filled in this call, and bytes already used in it
+        int slot = -1;
+        size_t slotUsed = 0;
+        while(!this->queue.empty() && frameBytes < budget)
+        {
+            TextureUpload& u = this->queue.front();
+            size_t rowSize = (size_t)u.width * u.bytesPerPixel;
+            // the current slot is full: we need the next one (a row must always fit in a slot)
+            if(slot < 0 || slotUsed + rowSize > TEXTURE_STREAMER_SLOT_SIZE)
+            {
+                if(slot >= 0)
+                    this->closeSlot(slot);
+                // the GPU is still reading the slot: we continue in the next frame
+                if(!this->slotFree(this->nextSlot))
+                {
+                    this->stalledFrames++;
+                    slot = -1;
+                    break;
+                }
+                slot = this->nextSlot;
+                slotUsed = 0;
+            }
+
+            size_t maxRows = std::min(TEXTURE_STREAMER_SLOT_SIZE - slotUsed, budget - frameBytes) / rowSize;
+            // at least one row per step
+            GLsizei rows = (GLsizei)std::max((size_t)1, std::min(maxRows, (size_t)(u.height - u.uploadedRows)));
+            size_t bytes = rows * rowSize;
+            GLintptr offset = (GLintptr)slot * TEXTURE_STREAMER_SLOT_SIZE + slotUsed;
+            const unsigned char* src = u.pixels.get() + (size_t)u.uploadedRows * rowSize;
+
+            if(this->persistent)
+                memcpy(this->mapped + offset, src, bytes);
+            else
+            {
+                void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+                memcpy(dst, src, bytes);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+
+            // with a PBO bound, the last parameter is the offset in the buffer
+            glBindTexture(u.bindTarget, u.texture);
+            glTexSubImage2D(u.target, u.level, 0, u.uploadedRows, u.width, rows, u.format, u.type, (GLvoid*)offset);
+            // the next copy starts 4-byte aligned
+            slotUsed += (bytes + 3) & ~(size_t)3;
+
+            u.uploadedRows += rows;
+            frameBytes += bytes;
+            if(u.uploadedRows >= u.height)
+            {
+                glBindTexture(u.bindTarget, 0);
+                std::function<void()> onComplete = u.onComplete;
+                this->queue.pop_front();
+                if(onComplete)
+                    onComplete();
+            }
+        }
+        if(slot >= 0)
+            this->closeSlot(slot);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        this->uploadedBytes += frameBytes;
+        return frameBytes;
+    }
+
+private:
+    GLuint pbo;
+    unsigned char* mapped;
+    bool persistent;
+    vector<GLsync> fences;
+    int nextSlot;
+    std::deque<TextureUpload> queue;
+
+    // the fence signals when the GPU has finished reading the slot, which can then be reused
+    void closeSlot(int slot)
+    {
+        this->fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->nextSlot = (slot + 1) % TEXTURE_STREAMER_SLOTS;
+    }
+
+    // the fence is checked without waiting
+    bool slotFree(int slot)
+    {
+        if(!this->fences[slot])
+            return true;
+        GLenum status = glClientWaitSync(this->fences[slot], 0, 0);
+        if(status == GL_TIMEOUT_EXPIRED)
+            return false;
+        glDeleteSync(this->fences[slot]);
+        this->fences[slot] = (GLsync)0;
+        return true;
+    }
+};
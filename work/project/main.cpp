@@ -103,6 +103,17 @@ positive Z axis points "outside" the screen
 #include <utils/gameObject.h>
 #include <utils/bullet.h>
 #include <utils/enemiesAI.h>
+#include <utils/renderQueue.h>
+#include <utils/jobSystem.h>
+#include <utils/textureStreamer.h>
+#include <utils/textureCompressor.h>
+#include <utils/textRenderer.h>
+#include <utils/gaussianKernel.h>
+#include <utils/gpuTimer.h>
+#include <utils/bokehKernel.h>
+#include <utils/noiseBaker.h>
+#include <utils/hitRegions.h>
+#include <utils/renderGraph.h>
 
 // we load the GLM classes used in the application
 #include <glm/glm.hpp>
@@ -118,24 +129,12 @@ positive Z axis points "outside" the screen
 #include FT_FREETYPE_H  
 
 #include <map>
+#include <memory>
+#include <thread>
 
 #define MAX_HIT 16
-#define NUMBER_OF_FBO 4
 
 
-struct Character {
-    unsigned int TextureID;  // ID handle of the glyph texture
-    glm::ivec2   Size;       // Size of glyph
-    glm::ivec2   Bearing;    // Offset from baseline to left/top of glyph
-    unsigned int Advance;    // Offset to advance to next glyph
-};
-
-enum textPosition{
-    TEXT_ALIGN_LEFT,
-    TEXT_ALIGN_CENTER,
-    TEXT_ALIGN_RIGHT,
-};
-
 enum modelsIndex{
     CUBE_MODEL=0,
     SPHERE_MODEL=1,
@@ -145,13 +144,55 @@ enum modelsIndex{
     BULLET_MODEL=1
 };
 
-std::map<char, Character> Characters;
-void RenderText(Shader &s, std::string text, float x, float y, float scale, glm::vec3 color, textPosition alignment=TEXT_ALIGN_LEFT);
+// the Signed Distance Fields of the glyphs are rendered in an atlas on a worker thread: until it is uploaded, the text is not displayed
+// all the strings of the frame are drawn with a single draw call (see textRenderer.h)
+TextRenderer textRenderer;
+void RenderText(std::string text, float x, float y, float scale, glm::vec3 color, textPosition alignment=TEXT_ALIGN_LEFT);
 int SetupFreetype(Shader &s);
 void DisplayUI(Shader &text_shader);
 // dimensions of application's window
 GLuint screenWidth = 800, screenHeight = 600;
 
+// render targets of the frame: the passes (scene, downsampling, blur, upsampling, temporal accumulation, hit mask, mix, UI) declare the targets they read and write,
+// and the render graph allocates them, sharing the textures between the targets not used at the same time, and culling the passes not needed (see renderGraph.h)
+// the scene is rendered at the size of the framebuffer (it is the only pass with a depth buffer), while the blur chain runs at renderScale times that size
+RenderGraph renderGraph;
+void DeclareRenderGraph(bool skipBlur, bool dof, int components, bool fusedPass, bool halfResDof);
+int framebufferWidth, framebufferHeight;
+int blurWidth, blurHeight;
+float renderScale = 1.0f;
+// blur pyramid (N key): the blur runs on the scene downsampled pyramidLevel times (0 = disabled), with the same radius in pixels, and the result is upsampled to the size of the blur targets
+#define PYRAMID_LEVELS 3
+int pyramidLevel = 0;
+// kernel of the GaussianBlur subroutine, generated at runtime with linear sampling (see gaussianKernel.h)
+// at full life, the radius and sigma are the ones of the original 31 taps kernel, and they grow with the damage (power, between 0 and 2)
+#define GAUSSIAN_BASE_RADIUS 15
+#define GAUSSIAN_BASE_SIGMA 3.5f
+GaussianKernel gaussianKernel;
+// kernels of the circular bokeh (DOFCircular), with 1 to 3 components (V key): see bokehKernel.h
+// the horizontal pass writes the real and imaginary parts of all the components in a single draw, to the target of the horizontal blur and to up to BOKEH_TARGETS more targets
+#define BOKEH_TARGETS 4
+BokehKernel bokehKernel;
+int bokehComponentCount = 1;
+// compute version of the blur passes (C key), with the taps read from shared memory (it needs OpenGL 4.3)
+// the GPU time of the blur passes is measured separately for the two versions: 0 = fragment shaders, 1 = compute shader
+bool computeBlur = false;
+bool computeBlurSupported = false;
+GpuTimer blurTimers[2];
+void DispatchComputeBlur(Shader &shader, const string &model, GLuint source, GLuint hTexture, GLuint imaginaryTexture, GLuint vTexture, int width, int height,
+                         const vector<glm::ivec4> &hRegions, const vector<glm::ivec4> &vRegions);
+// set when the framebuffer is resized or the render scale changes: the render targets are created again at the beginning of the next frame
+bool renderTargetsChanged = false;
+bool CreateRenderTargets();
+void ReleaseRenderTargets();
+bool CreateColorTarget(GLuint fbo, GLuint texture, int width, int height, GLenum attachment = GL_COLOR_ATTACHMENT0);
+// size of a level of the blur pyramid (the level 0 has the size of the blur targets)
+int PyramidSize(int size, int level){
+    return std::max(1, size >> level);
+}
+void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_size_callback(GLFWwindow* window, int width, int height);
+
 glm::mat4 view, projection;
 
 // we create a camera. We pass the initial position as a parameter to the constructor. The last boolean tells that we want a camera "anchored" to the ground
@@ -168,6 +209,83 @@ GLfloat lastHit;
 int hit_index=0;
 float hitRecoverTime=5.5;
 
+// hit mask, read by the Splash subroutine: the areas of the hits are rendered at HIT_MASK_SCALE times the framebuffer size, with a quad for each hit,
+// only when the hits (or the parameters of the noise) change
+#define HIT_MASK_SCALE 0.25f
+// half size of the quad of a hit, in texture coordinates (the largest distance from the hit in hitmask.frag)
+#define HIT_MASK_EXTENT 0.25f
+GLuint hitMaskFBO, hitMaskTexture;
+int hitMaskWidth, hitMaskHeight;
+// hits and parameters used for the current content of the mask
+GLfloat hitMaskPowers[MAX_HIT], hitMaskPoints[2*MAX_HIT], hitMaskFrequency, hitMaskHarmonics;
+bool hitMaskValid = false;
+int hitMaskUpdates = 0;
+void UpdateHitMask(Shader &shader, GLuint vao);
+
+// the noise read by hitmask.frag is baked on a worker thread (one layer for each number of octaves), and uploaded in a 2D array texture
+// until then, the hit mask is not rendered
+GLuint noiseTexture = 0;
+bool noiseReady = false;
+void BakeNoise();
+
+// with the Splash mix, the blurred image is used only around the hits: the blur passes are restricted (with glScissor, or dispatching only the groups of the rectangles)
+// to the rectangles of the tiles covered by the hits, enlarged by the apron of the kernel, and skipped when there are no hits
+HitRegions hitRegions;
+int blurSkippedFrames = 0;
+
+// temporal accumulation of the blur (T key): the blurred image is kept in a history (two targets at the size of the blur targets, written in turn), reprojected to the current camera
+// with the depth map; in each frame, only one of TEMPORAL_BANDS horizontal bands is blurred again, and the rest of the frame is read from the history
+// the whole frame is blurred again after new hits, large camera motions (largest change of an element of the view-projection matrix), and changes of the blur settings
+#define TEMPORAL_BANDS 4
+#define TEMPORAL_MAX_MOTION 0.05f
+// weight of the history in the refreshed band, to hide the seams between the bands
+#define TEMPORAL_FEEDBACK 0.25f
+bool temporalBlur = false;
+GLuint historyFBO[2], historyTexture[2];
+int historyIndex = 0;
+bool historyValid = false;
+int temporalBand = 0;
+// camera, hits and blur settings of the previous frame
+glm::mat4 previousViewProjection;
+GLfloat previousPowers[MAX_HIT];
+int previousBlurSettings[6];
+int temporalFullFrames = 0, temporalPartialFrames = 0;
+
+// vertical blur fused with the mix pass (F key): the vertical convolution is evaluated only for the pixels with a mix value > 0, without writing and reading the target of the vertical blur
+// it is not used with the compute blur, the pyramid and the temporal accumulation, which need the complete blurred image, and with a render scale < 1 (the mix pass would blur more pixels)
+bool fusedMix = true;
+
+// half resolution depth of field of the Distance mix (J key), in place of the blur chain: the scene is downsampled with the circle of confusion (CoC) computed from the depth and the life,
+// gathered at half resolution with a near/far split of the samples, and upsampled in the mix pass with bilateral weights (coc.frag, dofgather.frag, mix.frag)
+// the number of samples of a texel is proportional to the area of its CoC (DOF_SAMPLE_DENSITY samples for each texel, up to DOF_MAX_SAMPLES), so the texels in focus cost a single read
+// largest radius of the CoC, as a fraction of the height of the screen
+#define DOF_MAX_RADIUS 0.015f
+#define DOF_SAMPLE_DENSITY 0.5f
+#define DOF_MAX_SAMPLES 128
+bool halfResolutionDof = true;
+GpuTimer dofTimer;
+
+// HDR scene (U key cycles the format of the scene and of the result of the mix pass): with the float formats, the lighting above 1 is kept through the blur chain,
+// the luma trick of the DOF is not applied, and a tonemapping pass brings the result of the mix pass to the screen
+// the GPU time of the scene pass and of the passes after the blur (mix, luminance, tonemapping) is measured separately for each format, to compare their bandwidth
+#define SCENE_FORMATS 3
+const GLenum sceneFormats[SCENE_FORMATS] = {GL_RGBA8, GL_RGBA16F, GL_R11F_G11F_B10F};
+const string sceneFormatNames[SCENE_FORMATS] = {"RGBA8", "RGBA16F", "R11F_G11F_B10F"};
+int sceneFormat = 2;
+GpuTimer sceneTimers[SCENE_FORMATS], resolveTimers[SCENE_FORMATS];
+// auto-exposure (it needs OpenGL 4.3, like the compute blur): histogram of log2 of the luminance of the HDR image (luminance.comp),
+// and average luminance adapted over time (exposure.comp), in a 1x1 texture read by the tonemapping pass
+#define HISTOGRAM_BINS 256
+#define MIN_LOG_LUMINANCE -8.0f
+#define LOG_LUMINANCE_RANGE 12.0f
+// speed of the adaptation (1/seconds), luminance mapped to the middle of the curve, and limits of the exposure
+#define EXPOSURE_ADAPTATION_SPEED 1.5f
+#define EXPOSURE_KEY 0.4f
+#define MIN_EXPOSURE 0.25f
+#define MAX_EXPOSURE 4.0f
+GLuint histogramBuffer = 0, averageLuminanceTexture = 0;
+bool LumaTrickEnabled();
+
 // we initialize an array of booleans for each keybord key
 bool keys[1024];
 
@@ -241,6 +359,10 @@ GLfloat Ks = 0.4f;
 GLfloat Ka = 0.1f;
 
 GLboolean lumaTrick=GL_TRUE;
+// with the HDR scene, the DOF reads the real luminance
+bool LumaTrickEnabled(){
+    return lumaTrick && sceneFormats[sceneFormat] == GL_RGBA8;
+}
 GLboolean redOverlay=GL_FALSE;
 
 // boolean to activate/deactivate wireframe rendering
@@ -264,7 +386,9 @@ GLfloat maxSecPerFrame = 1.0f / 60.0f;
 // instance of the physics class
 Physics bulletSimulation;
 
-unsigned int textVAO, textVBO;
+// render queue used to sort the draws of the scene, and flag to print its statistics (R key)
+RenderQueue renderQueue(0.1f, 10000.0f);
+bool printQueueStats=false;
 
 float rectangleVertices[] =
 {
@@ -284,6 +408,15 @@ void SetupScene();
 void CleanScene();
 void LoadModels();
 
+// worker threads used to load the assets: the decoded images, the imported models and the rendered glyphs are uploaded by the main thread at the beginning of the frames
+// until then, the models are empty, the cube map has a placeholder color, and the text is not displayed
+JobSystem assetJobs;
+// models still not uploaded: the scene (which needs the meshes for the colliders) is set up when all of them are available
+int pendingModels = 0;
+bool sceneReady = false;
+// the decoded images are uploaded through a ring of PBOs, within a budget of bytes per frame
+TextureStreamer textureStreamer;
+
 bool gameHasStart=false;
 bool gameOver=false;
 int life;
@@ -312,8 +445,8 @@ int main()
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-  // we set if the window is resizable
-  glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+  // we set if the window is resizable (the render targets follow the size of the framebuffer)
+  glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
 
   // we create the application's window
     GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Project Milanesi 939908", nullptr, nullptr);
@@ -329,6 +462,8 @@ int main()
     glfwSetKeyCallback(window, key_callback);
     glfwSetMouseButtonCallback(window,mouse_button_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
+    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetWindowSizeCallback(window, window_size_callback);
 
 
     // we disable the mouse cursor
@@ -342,9 +477,8 @@ int main()
     }
 
     // we define the viewport dimensions
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    glViewport(0, 0, width, height);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
 
     // we enable Z test
     glEnable(GL_DEPTH_TEST);
@@ -352,20 +486,75 @@ int main()
     //the "clear" color for the frame buffer
     glClearColor(0.26f, 0.46f, 0.98f, 1.0f);
 
+    // the Shader Programs are loaded from the cache of their binaries, or compiled in parallel if the driver supports it (they are checked before their first use)
+    PFNGLMAXSHADERCOMPILERTHREADSKHRPROC maxShaderCompilerThreads = nullptr;
+    if(glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+        maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+    else if(glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+        maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSKHRPROC)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+    Shader::Configure(true, maxShaderCompilerThreads);
+    GLfloat shadersStart = glfwGetTime();
+
     // we create the Shader Program used for the plane
 
     Shader basic_shader("shaders/09_illumination_models.vert", "shaders/10_illumination_models.frag");
 
     // we create the Shader Program used for objects (which presents different subroutines we can switch)
     Shader horizontal_blur_shader = Shader("shaders/framebuffer.vert", "shaders/hblur.frag");
-    Shader immaginary_horizontal_blur_shader= Shader("shaders/framebuffer.vert", "shaders/hblurImgPart.frag");
     Shader vertical_blur_shader = Shader("shaders/framebuffer.vert", "shaders/vblur.frag");
     Shader mix_shader = Shader("shaders/framebuffer.vert", "shaders/mix.frag");
     Shader text_shader = Shader("shaders/text.vert", "shaders/text.frag");
+    // Shader Programs used to build the blur pyramid
+    Shader downsample_shader = Shader("shaders/framebuffer.vert", "shaders/downsample.frag");
+    Shader upsample_shader = Shader("shaders/framebuffer.vert", "shaders/upsample.frag");
+    // Shader Program used to render the hit mask
+    Shader hitmask_shader = Shader("shaders/hitmask.vert", "shaders/hitmask.frag");
+    Shader temporal_shader = Shader("shaders/framebuffer.vert", "shaders/temporal.frag");
+    Shader fused_mix_shader = Shader("shaders/framebuffer.vert", "shaders/vblurmix.frag");
+    // Shader Programs of the half resolution depth of field
+    Shader coc_shader = Shader("shaders/framebuffer.vert", "shaders/coc.frag");
+    Shader dof_gather_shader = Shader("shaders/framebuffer.vert", "shaders/dofgather.frag");
+    // the compute shaders are available only with OpenGL 4.3
+    computeBlurSupported = GLAD_GL_VERSION_4_3 != 0;
+    std::unique_ptr<Shader> compute_blur_shader;
+    if(computeBlurSupported)
+        compute_blur_shader.reset(new Shader("shaders/blur.comp"));
+    // Shader Programs of the HDR scene: tonemapping, and luminance histogram and average luminance of the auto-exposure
+    Shader tonemap_shader = Shader("shaders/framebuffer.vert", "shaders/tonemap.frag");
+    std::unique_ptr<Shader> luminance_shader, exposure_shader;
+    if(computeBlurSupported){
+        luminance_shader.reset(new Shader("shaders/luminance.comp"));
+        exposure_shader.reset(new Shader("shaders/exposure.comp"));
+    }
    
     // we create the Shader Program used for the environment map
     Shader skybox_shader("shaders/17_skybox.vert", "shaders/18_skybox.frag");
 
+    // loading of the Shader Programs: we poll the programs compiled in parallel until all of them are completed (processing the events of the window meanwhile),
+    // then we check their errors and save their binaries in the cache, before any query or use of the programs
+    // (the skybox program is never activated with Use, because it is drawn by the render queue)
+    vector<Shader*> programs = {&basic_shader, &horizontal_blur_shader, &vertical_blur_shader, &mix_shader, &text_shader, &downsample_shader, &upsample_shader,
+                                &hitmask_shader, &temporal_shader, &fused_mix_shader, &coc_shader, &dof_gather_shader, &tonemap_shader, &skybox_shader};
+    if(compute_blur_shader)
+        programs.push_back(compute_blur_shader.get());
+    if(luminance_shader){
+        programs.push_back(luminance_shader.get());
+        programs.push_back(exposure_shader.get());
+    }
+    int pollRounds = 0;
+    for(bool compiling = true; compiling; pollRounds++){
+        compiling = false;
+        for(size_t i = 0; i < programs.size(); i++)
+            compiling = compiling || !programs[i]->Ready();
+        if(compiling){
+            glfwPollEvents();
+            std::this_thread::yield();
+        }
+    }
+    for(size_t i = 0; i < programs.size(); i++)
+        programs[i]->Finish();
+    cout << "Shader programs: " << Shader::Global().loaded << " loaded from the cache, " << Shader::Global().compiled << " compiled"
+         << (Shader::Global().parallel ? " in parallel (" + std::to_string(pollRounds) + " polls)" : "") << ", " << (glfwGetTime() - shadersStart) * 1000.0 << " ms" << endl;
    
     // we parse the Shader Program to search for the number and names of the subroutines. 
     // the names are placed in the shaders vector
@@ -409,56 +598,52 @@ int main()
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-    unsigned int FBO[NUMBER_OF_FBO]; 
-	glGenFramebuffers(NUMBER_OF_FBO, FBO);
-
-    // Create Framebuffer Texture
-	unsigned int framebufferTexture[NUMBER_OF_FBO];
-	glGenTextures(NUMBER_OF_FBO, framebufferTexture);
+    if(!CreateRenderTargets())
+        return -1;
 
-    // Create Render Buffer Object
-	unsigned int RBO[NUMBER_OF_FBO];
-	glGenRenderbuffers(NUMBER_OF_FBO, RBO);
+    cout<<"all ok"<<endl;
 
-    for(int i=0;i<NUMBER_OF_FBO;i++){
-        glBindFramebuffer(GL_FRAMEBUFFER, FBO[i]);
-        glBindTexture(GL_TEXTURE_2D, framebufferTexture[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    textureStreamer.Init();
+
+    // the linear kernel must give the same result of the discrete one: we check it on the CPU for the smallest and largest radius
+    gaussianKernel.Init();
+    bokehKernel.Init();
+    bokehKernel.Update(bokehComponentCount);
+    cout << "Bokeh kernel: " << bokehKernel.components << " components, sum of the 2D kernel " << bokehKernel.kernelSum << endl;
+    blurTimers[0].Init();
+    blurTimers[1].Init();
+    dofTimer.Init();
+    for(int f = 0; f < SCENE_FORMATS; f++){
+        sceneTimers[f].Init();
+        resolveTimers[f].Init();
+    }
+    if(computeBlurSupported){
+        // the histogram starts empty (exposure.comp clears it after reading it), and the average luminance at 0 (no previous frame)
+        const GLuint emptyHistogram[HISTOGRAM_BINS] = {};
+        glGenBuffers(1, &histogramBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, histogramBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(emptyHistogram), emptyHistogram, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        const GLfloat noLuminance = 0.0f;
+        glGenTextures(1, &averageLuminanceTexture);
+        glBindTexture(GL_TEXTURE_2D, averageLuminanceTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &noLuminance);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE); // Prevents edge bleeding
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferTexture[i], 0);
-        glBindRenderbuffer(GL_RENDERBUFFER, RBO[i]);
-        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, RBO[i]);
-    
-        // Error checking framebuffer
-        auto fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-        if (fboStatus != GL_FRAMEBUFFER_COMPLETE){
-            std::cout << "Framebuffer "<<i<<" error: " << fboStatus << std::endl;
-            return -1;
-        }
+        glBindTexture(GL_TEXTURE_2D, 0);
     }
+    for(int r = GAUSSIAN_BASE_RADIUS; r <= 3 * GAUSSIAN_BASE_RADIUS; r += 2 * GAUSSIAN_BASE_RADIUS){
+        float error = GaussianKernel::ReferenceError(GAUSSIAN_BASE_SIGMA * r / GAUSSIAN_BASE_RADIUS, r);
+        cout << "Gaussian kernel radius " << r << ": " << 2 * r + 1 << " taps in " << 2 * GaussianKernel::Linear(GaussianKernel::Discrete(1.0f, r)).size() - 1
+             << " fetches, max error " << error << (error < 1e-4f ? " (ok)" : " (WRONG)") << endl;
+    }
+    BakeNoise();
 
-    GLuint depthMap;
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    // in the texture, we will save only the depth data of the fragments. Thus, we specify that we need to render only depth in the first rendering step
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    // we set to clamp the uv coordinates outside [0,1] to the color of the border
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    glBindFramebuffer(GL_FRAMEBUFFER, FBO[0]);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    cout<<"all ok"<<endl;
-
+    // the loading of the assets is started on the worker threads, and the rendering loop starts without waiting for them
+    GLfloat loadingStart = glfwGetTime();
+    bool firstFrame = true;
+    bool assetsLoaded = false;
     LoadModels();
-    SetupScene();
     
     // we load the cube map (we pass the path to the folder containing the 6 views)
     textureCube = LoadTextureCube("../../textures/cube/Park2/", "png");
@@ -468,7 +653,7 @@ int main()
 
 
     // Projection matrix: FOV angle, aspect ratio, near and far planes
-    projection = glm::perspective(45.0f, (float)screenWidth/(float)screenHeight, 0.1f, 10000.0f);
+    projection = glm::perspective(45.0f, (float)framebufferWidth/(float)framebufferHeight, 0.1f, 10000.0f);
     // View matrix (=camera): position, view direction, camera "up" vector
     view = glm::lookAt(glm::vec3(0.0f, 0.0f, 7.0f), glm::vec3(0.0f, 0.0f, -7.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
@@ -496,13 +681,18 @@ int main()
     // Rendering loop: this code is executed at each frame
     while(!glfwWindowShouldClose(window))
     {
-       // Bind the custom framebuffer
-		glBindFramebuffer(GL_FRAMEBUFFER, FBO[0]);
-        glClearColor(0.26f, 0.46f, 0.98f, 1.0f);
-		// Clean the back buffer and depth buffer
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		// Enable depth testing since it's disabled when drawing the framebuffer rectangle
-		glEnable(GL_DEPTH_TEST);
+        // the window is minimized: we wait until it is visible again
+        if(framebufferWidth == 0 || framebufferHeight == 0){
+            glfwWaitEvents();
+            continue;
+        }
+        if(renderTargetsChanged){
+            ReleaseRenderTargets();
+            if(!CreateRenderTargets())
+                return -1;
+            projection = glm::perspective(45.0f, (float)framebufferWidth/(float)framebufferHeight, 0.1f, 10000.0f);
+            renderTargetsChanged = false;
+        }
         basic_shader.Use();
         // we determine the time passed from the beginning
         // and we calculate the time difference between current frame rendering and the previous one
@@ -512,14 +702,23 @@ int main()
         fps= 1.0/deltaTime;
         // Check is an I/O event is happening
         glfwPollEvents();
+        // we upload the assets loaded in the meantime by the worker threads
+        assetJobs.ProcessMainThread();
+        textureStreamer.Update();
+        if(!sceneReady && pendingModels == 0){
+            SetupScene();
+            sceneReady = true;
+        }
+        if(!assetsLoaded && sceneReady && assetJobs.Idle() && textureStreamer.Idle()){
+            assetsLoaded = true;
+            cout << "All the assets loaded after " << glfwGetTime() - loadingStart << " s (" << textureStreamer.uploadedBytes
+                 << " bytes streamed, " << textureStreamer.stalledFrames << " frames waiting for a free PBO)" << endl;
+        }
         // we apply FPS camera movements
         apply_camera_movements();
         // View matrix (=camera): position, view direction, camera "up" vector
         view = camera.GetViewMatrix();
 
-        // we "clear" the frame and z buffer
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
         // we set the rendering mode
         if (wireframe)
             // Draw in wireframe
@@ -553,191 +752,473 @@ int main()
             }
         }
 
-        /////////////////// PLANE ////////////////////////////////////////////////
-        // We render a plane under the objects. We apply the fullcolor shader to the plane, and we do not apply the rotation applied to the other objects.
-        basic_shader.Use();
+        /////////////////// RENDER GRAPH /////////////////////////////////////////
+        // the passes of the frame depend on the blur settings and on the hits (with the Splash mix and no hits, the blurred image is not needed)
+        bool splashOnly = gameHasStart && mix_shaders[mix_subroutine] == "Splash";
+        if(splashOnly)
+            hitRegions.Build(hitPoints, powers, MAX_HIT, HIT_MASK_EXTENT + 1.0f / std::min(hitMaskWidth, hitMaskHeight));
+        bool skipBlur = splashOnly && hitRegions.Empty();
+        bokehKernel.Update(bokehComponentCount);
+        bool dof = blur_shaders[blur_subroutine].find("DOF") != std::string::npos;
+        int components = blur_shaders[blur_subroutine] == "DOFCircular" ? bokehKernel.components : 1;
+        bool halfResDof = halfResolutionDof && gameHasStart && mix_shaders[mix_subroutine] == "Distance";
+        // the vertical blur can be fused with the mix pass only if its result is not needed as an image, and if the two passes have the same size
+        bool fusedPass = fusedMix && !computeBlur && pyramidLevel == 0 && !temporalBlur && !halfResDof && blurWidth == framebufferWidth && blurHeight == framebufferHeight;
+        DeclareRenderGraph(skipBlur, dof, components, fusedPass, halfResDof);
+        renderGraph.Compile("screen");
+
+        // Bind the custom framebuffer
+        renderGraph.BindFramebuffer("scene");
+        glClearColor(0.26f, 0.46f, 0.98f, 1.0f);
+		// Clean the back buffer and depth buffer
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		// Enable depth testing since it's disabled when drawing the framebuffer rectangle
+		glEnable(GL_DEPTH_TEST);
+        sceneTimers[sceneFormat].Begin();
+
+        /////////////////// SCENE ////////////////////////////////////////////////
+        // we fill the render queue with a packet for each mesh to draw: the plane, the objects and the skybox
+        // the queue sorts the packets on the basis of the OpenGL state they need, and it changes the state only when needed
+        renderQueue.Clear();
+        renderQueue.SetProjection(projection, (float)framebufferHeight);
         // for the plane, we use only Lambert model.
         // Thus, we search inside the Shader Program the name of the subroutine, and we get the numerical index
-        GLuint index = glGetSubroutineIndex(basic_shader.Program, GL_FRAGMENT_SHADER, "Lambert");
-        // we activate the subroutine using the index
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-
-        // we pass projection and view matrices to the Shader Program of the plane
-        glUniformMatrix4fv(glGetUniformLocation(basic_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        glUniformMatrix4fv(glGetUniformLocation(basic_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+        GLuint planeSubroutine = glGetSubroutineIndex(basic_shader.Program, GL_FRAGMENT_SHADER, "Lambert");
+        renderQueue.Submit(PASS_OPAQUE, basic_shader.Program, planeSubroutine, &plane, view);
 
-        // we determine the position in the Shader Program of the uniform variables
-        GLint pointLightLocation = glGetUniformLocation(basic_shader.Program, "pointLightPosition");
-        GLint matDiffuseLocation = glGetUniformLocation(basic_shader.Program, "diffuseColor");
-        GLint kdLocation = glGetUniformLocation(basic_shader.Program, "Kd");
-
-        // we assign the value to the uniform variables
-        glUniform3fv(pointLightLocation, 1, glm::value_ptr(lightPos0));
-        glUniform3fv(matDiffuseLocation, 1, planeColor);
-        glUniform1f(kdLocation, Kd);
-
-
-        // we render the plane
-        plane.Draw(view,basic_shader);
-
-        /////////////////// OBJECTS ////////////////////////////////////////////////
         // We use the same Shader Program for the objects, but in this case we will do shaders swapping
         // we search inside the Shader Program the name of the subroutine currently selected, and we get the numerical index
-        index = glGetSubroutineIndex(basic_shader.Program, GL_FRAGMENT_SHADER, shaders[current_subroutine].c_str());
-        // we activate the subroutine using the index (this is where shaders swapping happens)
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-
-        // we determine the position in the Shader Program of the uniform variables
-        GLint matAmbientLocation = glGetUniformLocation(basic_shader.Program, "ambientColor");
-        GLint matSpecularLocation = glGetUniformLocation(basic_shader.Program, "specularColor");
-        GLint kaLocation = glGetUniformLocation(basic_shader.Program, "Ka");
-        GLint ksLocation = glGetUniformLocation(basic_shader.Program, "Ks");
-
-        // we assign the value to the uniform variables
-        glUniform3fv(matDiffuseLocation, 1, diffuseColor);
-        glUniform3fv(matAmbientLocation, 1, ambientColor);
-        glUniform3fv(matSpecularLocation, 1, specularColor);
-        glUniform1f(kaLocation, Ka);
-        glUniform1f(ksLocation, Ks);
-
-        for (auto gameObject : scene) // access by reference to avoid copying
-        {  
-
-            gameObject->Draw(view,basic_shader);
+        GLuint objectSubroutine = glGetSubroutineIndex(basic_shader.Program, GL_FRAGMENT_SHADER, shaders[current_subroutine].c_str());
+        for (auto gameObject : scene)
+        {
+            renderQueue.Submit(PASS_OPAQUE, basic_shader.Program, objectSubroutine, gameObject, view);
         }
-        
-        /////////////////// SKYBOX ////////////////////////////////////////////////
+
         // we use the cube to attach the 6 textures of the environment map.
         // we render it after all the other objects, in order to avoid the depth tests as much as possible.
-        // we will set, in the vertex shader for the skybox, all the values to the maximum depth. Thus, the environment map is rendered only where there are no other objects in the image (so, only on the background).
-        //Thus, we set the depth test to GL_LEQUAL, in order to let the fragments of the background pass the depth test (because they have the maximum depth possible, and the default setting is GL_LESS)
-        glDepthFunc(GL_LEQUAL);
-        skybox_shader.Use();
-        // we activate the cube map
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
-         // we pass projection and view matrices to the Shader Program of the skybox
-        glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
-        // to have the background fixed during camera movements, we have to remove the translations from the view matrix
-        // thus, we consider only the top-left submatrix, and we create a new 4x4 matrix
-        view = glm::mat4(glm::mat3(view)); // Remove any translation component of the view matrix
-        glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
-
-        // we determine the position in the Shader Program of the uniform variables
-        GLint textureLocation = glGetUniformLocation(skybox_shader.Program, "tCube");
-        // we assign the value to the uniform variable
-        glUniform1i(textureLocation, 0);
-
-        // we render the cube with the environment map
-        models[CUBE_MODEL]->Draw();
+        // (the cube may still be loading)
+        if(!models[CUBE_MODEL]->meshes.empty())
+            renderQueue.Submit(PASS_SKYBOX, skybox_shader.Program, GL_INVALID_INDEX, &models[CUBE_MODEL]->meshes[0], nullptr, 0.0f);
+
+        renderQueue.Sort();
+        renderQueue.Flush(view, [&](unsigned int pass){
+            if(pass == PASS_OPAQUE){
+                // we pass projection and view matrices to the Shader Program
+                glUniformMatrix4fv(glGetUniformLocation(basic_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
+                glUniformMatrix4fv(glGetUniformLocation(basic_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(view));
+
+                // we determine the position in the Shader Program of the uniform variables
+                GLint pointLightLocation = glGetUniformLocation(basic_shader.Program, "pointLightPosition");
+                GLint kdLocation = glGetUniformLocation(basic_shader.Program, "Kd");
+                GLint matAmbientLocation = glGetUniformLocation(basic_shader.Program, "ambientColor");
+                GLint matSpecularLocation = glGetUniformLocation(basic_shader.Program, "specularColor");
+                GLint kaLocation = glGetUniformLocation(basic_shader.Program, "Ka");
+                GLint ksLocation = glGetUniformLocation(basic_shader.Program, "Ks");
+
+                // we assign the value to the uniform variables
+                // (the diffuse color is set by each object)
+                glUniform3fv(pointLightLocation, 1, glm::value_ptr(lightPos0));
+                glUniform1f(kdLocation, Kd);
+                glUniform3fv(matAmbientLocation, 1, ambientColor);
+                glUniform3fv(matSpecularLocation, 1, specularColor);
+                glUniform1f(kaLocation, Ka);
+                glUniform1f(ksLocation, Ks);
+            }
+            else if(pass == PASS_SKYBOX){
+                /////////////////// SKYBOX ////////////////////////////////////////////////
+                // we will set, in the vertex shader for the skybox, all the values to the maximum depth. Thus, the environment map is rendered only where there are no other objects in the image (so, only on the background).
+                //Thus, we set the depth test to GL_LEQUAL, in order to let the fragments of the background pass the depth test (because they have the maximum depth possible, and the default setting is GL_LESS)
+                glDepthFunc(GL_LEQUAL);
+                // we activate the cube map
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_CUBE_MAP, textureCube);
+                // we pass projection and view matrices to the Shader Program of the skybox
+                glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "projectionMatrix"), 1, GL_FALSE, glm::value_ptr(projection));
+                // to have the background fixed during camera movements, we have to remove the translations from the view matrix
+                // thus, we consider only the top-left submatrix, and we create a new 4x4 matrix
+                glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // Remove any translation component of the view matrix
+                glUniformMatrix4fv(glGetUniformLocation(skybox_shader.Program, "viewMatrix"), 1, GL_FALSE, glm::value_ptr(skyboxView));
+                // we assign the value to the uniform variable
+                glUniform1i(glGetUniformLocation(skybox_shader.Program, "tCube"), 0);
+            }
+        });
         // we set again the depth test to the default operation for the next frame
         glDepthFunc(GL_LESS);
+        sceneTimers[sceneFormat].End();
+        if(printQueueStats){
+            cout << "Render queue: " << renderQueue.stats.drawCalls << " draws, " << renderQueue.stats.programBinds << " program binds, "
+                 << renderQueue.stats.subroutineBinds << " subroutine binds, " << renderQueue.stats.vaoBinds << " VAO binds, "
+                 << renderQueue.BindsAvoided() << " redundant binds avoided" << endl;
+            cout << "Text: " << textRenderer.lastQuads << " glyphs in 1 draw, " << textRenderer.layoutsBuilt << " strings shaped, "
+                 << textRenderer.glyphsRendered << " glyphs rendered, " << textRenderer.glyphsEvicted << " evicted since the start" << endl;
+            cout << "Blur passes (GPU time): fragment shaders " << blurTimers[0].Average() << " ms (" << blurTimers[0].samples << " frames), compute shader "
+                 << blurTimers[1].Average() << " ms (" << blurTimers[1].samples << " frames)" << endl;
+            cout << "Hit mask: rendered " << hitMaskUpdates << " times since the start" << endl;
+            cout << "Blur regions: " << hitRegions.rects.size() << " rectangles, " << hitRegions.Coverage() * 100.0f << "% of the screen, blur skipped in "
+                 << blurSkippedFrames << " frames since the start" << endl;
+            cout << "Temporal blur: " << (temporalBlur ? "enabled" : "disabled") << ", " << temporalFullFrames << " frames fully blurred, "
+                 << temporalPartialFrames << " frames with 1/" << TEMPORAL_BANDS << " of the frame blurred" << endl;
+            cout << "Render graph: " << renderGraph.livePasses << " passes (" << renderGraph.culledPasses << " culled), " << renderGraph.liveTargets << " targets in "
+                 << renderGraph.textures << " textures, " << renderGraph.textureBytes / (1024 * 1024) << " MB (" << renderGraph.targetBytes / (1024 * 1024)
+                 << " MB without aliasing), " << renderGraph.compilations << " compilations since the start" << endl;
+            cout << "Half resolution DOF: " << (halfResolutionDof ? "enabled" : "disabled") << ", " << dofTimer.Average() << " ms (GPU time, " << dofTimer.samples << " frames)" << endl;
+            cout << "Scene format: " << sceneFormatNames[sceneFormat];
+            if(averageLuminanceTexture && sceneFormat > 0){
+                // (it waits for the GPU, only when the statistics are printed)
+                GLfloat averageLuminance = 0.0f;
+                glBindTexture(GL_TEXTURE_2D, averageLuminanceTexture);
+                glGetTexImage(GL_TEXTURE_2D, 0, GL_RED, GL_FLOAT, &averageLuminance);
+                cout << ", average luminance " << averageLuminance << ", exposure "
+                     << std::max(MIN_EXPOSURE, std::min(MAX_EXPOSURE, EXPOSURE_KEY / std::max(averageLuminance, 1e-4f)));
+            }
+            cout << endl;
+            for(int f = 0; f < SCENE_FORMATS; f++)
+                cout << "  " << sceneFormatNames[f] << ": scene " << sceneTimers[f].Average() << " ms, mix and tonemapping " << resolveTimers[f].Average()
+                     << " ms (GPU time, " << sceneTimers[f].samples << " frames)" << endl;
+            cout << "Gaussian blur: radius " << gaussianKernel.radius << ", " << 2 * gaussianKernel.tapCount - 1 << " fetches per pass" << endl;
+            printQueueStats = false;
+        }
 
         // Faccio lo swap tra back e front buffer
         // Bind the intermediate framebuffer
         
-    	glBindFramebuffer(GL_FRAMEBUFFER, FBO[1]);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-        
-        horizontal_blur_shader.Use();
-        index = glGetSubroutineIndex(horizontal_blur_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
-        // we activate the subroutine using the index (this is where shaders swapping happens)
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-        glUniform1i(glGetUniformLocation(horizontal_blur_shader.Program, "screenTexture"), 1);
-        glUniform1i(glGetUniformLocation(horizontal_blur_shader.Program, "lumaTrick"), lumaTrick);
-
-		// Draw the framebuffer rectangle
-		glActiveTexture(GL_TEXTURE1);
         glBindVertexArray(rectVAO);
 		glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
-		glBindTexture(GL_TEXTURE_2D, framebufferTexture[0]);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
-        
 
+        // the radius of the Gaussian blur grows with the damage (the buffer is updated only when the radius changes)
+        float damageScale = 1.0f + power;
+        gaussianKernel.Update(GAUSSIAN_BASE_SIGMA * damageScale, (int)round(GAUSSIAN_BASE_RADIUS * damageScale));
+
+        // source and targets of the blur passes (allocated by the render graph), and their size (the blur chain runs at the render scale)
+        GLuint blurSource = renderGraph.Texture("sceneColor");
+        GLuint hBlurTexture = renderGraph.Texture("hblur");
+        GLuint hBokehTextures[BOKEH_TARGETS];
+        for(int t = 0; t < BOKEH_TARGETS; t++)
+            hBokehTextures[t] = renderGraph.Texture("bokeh" + std::to_string(t));
+        GLuint imaginaryTexture = renderGraph.Texture("imaginary");
+        GLuint vBlurTexture = renderGraph.Texture(pyramidLevel > 0 ? "vblur" : "blur");
+        int passWidth = PyramidSize(blurWidth, pyramidLevel), passHeight = PyramidSize(blurHeight, pyramidLevel);
+        if(renderGraph.Enabled("downsample1")){
+            // with the pyramid, the scene is downsampled, and the blur passes run on the smallest level
+            downsample_shader.Use();
+            glUniform1i(glGetUniformLocation(downsample_shader.Program, "sourceTexture"), 1);
+            glActiveTexture(GL_TEXTURE1);
+            int sourceWidth = framebufferWidth, sourceHeight = framebufferHeight;
+            for(int l = 1; l <= pyramidLevel; l++){
+                renderGraph.BindFramebuffer("downsample" + std::to_string(l));
+                glUniform2f(glGetUniformLocation(downsample_shader.Program, "sourceTexelSize"), 1.0f/sourceWidth, 1.0f/sourceHeight);
+                glBindTexture(GL_TEXTURE_2D, blurSource);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                blurSource = renderGraph.Texture("down" + std::to_string(l));
+                sourceWidth = PyramidSize(blurWidth, l);
+                sourceHeight = PyramidSize(blurHeight, l);
+            }
+        }
 
-        if(blur_shaders[blur_subroutine].find("DOF")!= std::string::npos){
-            glBindFramebuffer(GL_FRAMEBUFFER,FBO[3]);
-    		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            immaginary_horizontal_blur_shader.Use();
-            index = glGetSubroutineIndex(immaginary_horizontal_blur_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
+        // with the temporal accumulation, the whole frame is blurred again only if the history cannot be reused
+        glm::mat4 viewProjection = projection * view;
+        int blurSettings[] = {(int)blur_subroutine, pyramidLevel, (int)computeBlur, bokehComponentCount, (int)LumaTrickEnabled(), (int)splashOnly};
+        bool refreshAll = true;
+        if(temporalBlur && !skipBlur){
+            bool newHit = false;
+            for(int i = 0; i < MAX_HIT; i++)
+                newHit = newHit || powers[i] > previousPowers[i];
+            float motion = 0.0f;
+            for(int c = 0; c < 4; c++)
+                for(int r = 0; r < 4; r++)
+                    motion = std::max(motion, fabs(viewProjection[c][r] - previousViewProjection[c][r]));
+            refreshAll = !historyValid || newHit || motion > TEMPORAL_MAX_MOTION || memcmp(blurSettings, previousBlurSettings, sizeof(blurSettings)) != 0;
+        }
+        // areas to blur (in texture coordinates): the whole frame, or the tiles of the hits, limited to the band refreshed in this frame
+        vector<HitRegion> blurAreas;
+        if(splashOnly)
+            blurAreas = hitRegions.rects;
+        else{
+            HitRegion frame = {0.0f, 0.0f, 1.0f, 1.0f};
+            blurAreas.push_back(frame);
+        }
+        float bandStart = 0.0f, bandEnd = 1.0f;
+        if(!refreshAll){
+            bandStart = (float)temporalBand / TEMPORAL_BANDS;
+            bandEnd = (float)(temporalBand + 1) / TEMPORAL_BANDS;
+            temporalBand = (temporalBand + 1) % TEMPORAL_BANDS;
+        }
+        // pixels written by the vertical pass (with a margin for the upsampling and the bilinear filtering), and by the horizontal pass (plus the apron of the vertical kernel)
+        vector<glm::ivec4> hRegions, vRegions;
+        float apron = (float)std::max(gaussianKernel.radius + 1, BOKEH_RADIUS) / blurHeight;
+        float marginX = (float)(2 << pyramidLevel) / blurWidth, marginY = (float)(2 << pyramidLevel) / blurHeight;
+        for(size_t r = 0; r < blurAreas.size(); r++){
+            blurAreas[r].y0 = std::max(blurAreas[r].y0, bandStart);
+            blurAreas[r].y1 = std::min(blurAreas[r].y1, bandEnd);
+            if(blurAreas[r].y1 <= blurAreas[r].y0)
+                continue;
+            vRegions.push_back(HitRegions::Pixels(blurAreas[r], marginX, marginY, passWidth, passHeight));
+            hRegions.push_back(HitRegions::Pixels(blurAreas[r], marginX, marginY + apron, passWidth, passHeight));
+        }
+
+        GLuint index;
+        if(skipBlur){
+            // no hits: the mix pass does not read the blurred image
+            blurSkippedFrames++;
+        }
+        else if(halfResDof){
+            // the Distance mix reads the half resolution depth of field (below)
+        }
+        else if(computeBlur){
+            // only the frames that run the blur passes are timed
+            blurTimers[1].Begin();
+            DispatchComputeBlur(*compute_blur_shader, blur_shaders[blur_subroutine], blurSource, hBlurTexture, imaginaryTexture, vBlurTexture, passWidth, passHeight, hRegions, vRegions);
+            blurTimers[1].End();
+        }
+        else{
+            blurTimers[0].Begin();
+            // the rectangles cover the pixels read by the following passes, so the targets are not cleared
+            glEnable(GL_SCISSOR_TEST);
+            // with the DOF, the horizontal pass writes 2 targets for 1 component (DOFSquare has always 1 component), 3 for 2 components, 5 for 3 components (see DeclareRenderGraph)
+            renderGraph.BindFramebuffer("hblur");
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        
+            horizontal_blur_shader.Use();
+            // distance between the samples of the blur, in texture coordinates: it does not change with the pyramid, so the radius of the blur is the same
+            glUniform2f(glGetUniformLocation(horizontal_blur_shader.Program, "texelSize"), 1.0f/blurWidth, 1.0f/blurHeight);
+            index = glGetSubroutineIndex(horizontal_blur_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
             // we activate the subroutine using the index (this is where shaders swapping happens)
             glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-            glUniform1i(glGetUniformLocation(immaginary_horizontal_blur_shader.Program, "screenTexture"), 1);
-            glUniform1i(glGetUniformLocation(immaginary_horizontal_blur_shader.Program, "lumaTrick"), lumaTrick);
+            glUniform1i(glGetUniformLocation(horizontal_blur_shader.Program, "screenTexture"), 1);
+            glUniform1i(glGetUniformLocation(horizontal_blur_shader.Program, "lumaTrick"), LumaTrickEnabled());
 
-		    // Draw the framebuffer rectangle
-            glActiveTexture(GL_TEXTURE1);
+    		// Draw the framebuffer rectangle
+    		glActiveTexture(GL_TEXTURE1);
             glBindVertexArray(rectVAO);
-            glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
-            glBindTexture(GL_TEXTURE_2D, framebufferTexture[0]);
-            glDrawArrays(GL_TRIANGLES, 0, 6);
-		    glActiveTexture(GL_TEXTURE3);
-    		glBindTexture(GL_TEXTURE_2D, framebufferTexture[3]);
-		    glActiveTexture(GL_TEXTURE0);
-        }
+    		glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
+    		glBindTexture(GL_TEXTURE_2D, blurSource);
+            for(size_t r = 0; r < hRegions.size(); r++){
+                glScissor(hRegions[r].x, hRegions[r].y, hRegions[r].z, hRegions[r].w);
+    		    glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
         
-        glBindFramebuffer(GL_FRAMEBUFFER,FBO[2]);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        vertical_blur_shader.Use();
-        index = glGetSubroutineIndex(vertical_blur_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
-        // we activate the subroutine using the index (this is where shaders swapping happens)
-        glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
-        glUniform1i(glGetUniformLocation(vertical_blur_shader.Program, "screenTexture"), 2);
-        glUniform1i(glGetUniformLocation(vertical_blur_shader.Program, "immaginaryTexture"), 3);
-        glUniform1i(glGetUniformLocation(vertical_blur_shader.Program, "lumaTrick"), lumaTrick);
+
+
+            // with the fused pass, the vertical blur is computed by the mix pass, only where the mix value is > 0
+            if(!fusedPass){
+                renderGraph.BindFramebuffer("vblur");
+                vertical_blur_shader.Use();
+                glUniform2f(glGetUniformLocation(vertical_blur_shader.Program, "texelSize"), 1.0f/blurWidth, 1.0f/blurHeight);
+                index = glGetSubroutineIndex(vertical_blur_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
+                // we activate the subroutine using the index (this is where shaders swapping happens)
+                glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
+                glUniform1i(glGetUniformLocation(vertical_blur_shader.Program, "screenTexture"), 2);
+                glUniform1i(glGetUniformLocation(vertical_blur_shader.Program, "lumaTrick"), LumaTrickEnabled());
+                if(dof){
+                    // the other outputs of the horizontal pass of the bokeh are bound to the texture units 3, 4, 7 and 8
+                    const GLint bokehUnits[BOKEH_TARGETS] = {3, 4, 7, 8};
+                    glUniform1iv(glGetUniformLocation(vertical_blur_shader.Program, "bokehTexture"), BOKEH_TARGETS, bokehUnits);
+                    for(int t = 0; t < BOKEH_TARGETS; t++){
+                        glActiveTexture(GL_TEXTURE0 + bokehUnits[t]);
+                        glBindTexture(GL_TEXTURE_2D, hBokehTextures[t]);
+                    }
+                }
     
-		// Draw the framebuffer rectangle
-		glActiveTexture(GL_TEXTURE2);
-		glBindVertexArray(rectVAO);
-		glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
-		glBindTexture(GL_TEXTURE_2D, framebufferTexture[1]);
-		glDrawArrays(GL_TRIANGLES, 0, 6);
+        		// Draw the framebuffer rectangle
+        		glActiveTexture(GL_TEXTURE2);
+        		glBindVertexArray(rectVAO);
+        		glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
+        		glBindTexture(GL_TEXTURE_2D, hBlurTexture);
+                for(size_t r = 0; r < vRegions.size(); r++){
+                    glScissor(vRegions[r].x, vRegions[r].y, vRegions[r].z, vRegions[r].w);
+        		    glDrawArrays(GL_TRIANGLES, 0, 6);
+                }
+            }
+            glDisable(GL_SCISSOR_TEST);
+            blurTimers[0].End();
+        }
+
+        if(renderGraph.Enabled("upsample0")){
+            // the blurred image is upsampled level by level, up to the target read by the mix pass
+            upsample_shader.Use();
+            glUniform1i(glGetUniformLocation(upsample_shader.Program, "sourceTexture"), 2);
+            glActiveTexture(GL_TEXTURE2);
+            GLuint source = vBlurTexture;
+            for(int l = pyramidLevel - 1; l >= 0; l--){
+                renderGraph.BindFramebuffer("upsample" + std::to_string(l));
+                glUniform2f(glGetUniformLocation(upsample_shader.Program, "sourceTexelSize"), 1.0f/PyramidSize(blurWidth, l + 1), 1.0f/PyramidSize(blurHeight, l + 1));
+                glBindTexture(GL_TEXTURE_2D, source);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                source = renderGraph.Texture(l == 0 ? "blur" : "up" + std::to_string(l));
+            }
+        }
+
+        // the blur of this frame is merged with the reprojected history, and the result becomes the new history
+        GLuint blurResult = renderGraph.Texture("blur");
+        if(renderGraph.Enabled("temporal")){
+            glBindFramebuffer(GL_FRAMEBUFFER, historyFBO[historyIndex]);
+            glViewport(0, 0, blurWidth, blurHeight);
+            temporal_shader.Use();
+            glUniform1i(glGetUniformLocation(temporal_shader.Program, "currentTexture"), 2);
+            glUniform1i(glGetUniformLocation(temporal_shader.Program, "historyTexture"), 3);
+            glUniform1i(glGetUniformLocation(temporal_shader.Program, "zmap"), 5);
+            glUniformMatrix4fv(glGetUniformLocation(temporal_shader.Program, "inverseViewProjection"), 1, GL_FALSE, glm::value_ptr(glm::inverse(viewProjection)));
+            glUniformMatrix4fv(glGetUniformLocation(temporal_shader.Program, "previousViewProjection"), 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+            glUniform2f(glGetUniformLocation(temporal_shader.Program, "refreshedBand"), bandStart, bandEnd);
+            glUniform1f(glGetUniformLocation(temporal_shader.Program, "feedback"), refreshAll ? 0.0f : TEMPORAL_FEEDBACK);
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("blur"));
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, historyTexture[1 - historyIndex]);
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("sceneDepth"));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            blurResult = historyTexture[historyIndex];
+            historyIndex = 1 - historyIndex;
+            historyValid = true;
+            if(refreshAll)
+                temporalFullFrames++;
+            else
+                temporalPartialFrames++;
+        }
+        else
+            historyValid = false;
+        previousViewProjection = viewProjection;
+        memcpy(previousPowers, powers, sizeof(powers));
+        memcpy(previousBlurSettings, blurSettings, sizeof(blurSettings));
+
+
+        if(renderGraph.Enabled("coc")){
+            // half resolution depth of field: downsampling with the CoC, then gather
+            dofTimer.Begin();
+            int halfWidth = PyramidSize(framebufferWidth, 1), halfHeight = PyramidSize(framebufferHeight, 1);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+            glDisable(GL_DEPTH_TEST);
+            glBindVertexArray(rectVAO);
+            renderGraph.BindFramebuffer("coc");
+            coc_shader.Use();
+            glUniform1i(glGetUniformLocation(coc_shader.Program, "screenTexture"), 1);
+            glUniform1i(glGetUniformLocation(coc_shader.Program, "zmap"), 5);
+            glUniform1i(glGetUniformLocation(coc_shader.Program, "life"), life);
+            glUniform2f(glGetUniformLocation(coc_shader.Program, "sourceTexelSize"), 1.0f/framebufferWidth, 1.0f/framebufferHeight);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("sceneColor"));
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("sceneDepth"));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+
+            renderGraph.BindFramebuffer("dofgather");
+            dof_gather_shader.Use();
+            glUniform1i(glGetUniformLocation(dof_gather_shader.Program, "cocTexture"), 1);
+            glUniform2f(glGetUniformLocation(dof_gather_shader.Program, "texelSize"), 1.0f/halfWidth, 1.0f/halfHeight);
+            glUniform1f(glGetUniformLocation(dof_gather_shader.Program, "maxRadius"), DOF_MAX_RADIUS * halfHeight);
+            glUniform1f(glGetUniformLocation(dof_gather_shader.Program, "sampleDensity"), DOF_SAMPLE_DENSITY);
+            glUniform1i(glGetUniformLocation(dof_gather_shader.Program, "maxSamples"), DOF_MAX_SAMPLES);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("cocHalf"));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            dofTimer.End();
+            blurResult = renderGraph.Texture("dofHalf");
+        }
 
+        UpdateHitMask(hitmask_shader, rectVAO);
 
-    	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // with the HDR scene, the mix pass writes the HDR target read by the tonemapping
+        resolveTimers[sceneFormat].Begin();
+        renderGraph.BindFramebuffer("mix");
+        glViewport(0, 0, framebufferWidth, framebufferHeight);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        mix_shader.Use();
-        if(gameHasStart){
-            index = glGetSubroutineIndex(mix_shader.Program, GL_FRAGMENT_SHADER, mix_shaders[mix_subroutine].c_str());
-            glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
+        Shader &final_shader = fusedPass ? fused_mix_shader : mix_shader;
+        final_shader.Use();
+        string mixName = gameHasStart ? mix_shaders[mix_subroutine] : "FullBlur";
+        if(fusedPass){
+            // the fused pass has two subroutine uniforms: the indices are passed in the order of their locations
+            GLuint indices[2];
+            indices[glGetSubroutineUniformLocation(final_shader.Program, GL_FRAGMENT_SHADER, "Blur_Model")] =
+                glGetSubroutineIndex(final_shader.Program, GL_FRAGMENT_SHADER, blur_shaders[blur_subroutine].c_str());
+            indices[glGetSubroutineUniformLocation(final_shader.Program, GL_FRAGMENT_SHADER, "Mix_Model")] =
+                glGetSubroutineIndex(final_shader.Program, GL_FRAGMENT_SHADER, mixName.c_str());
+            glUniformSubroutinesuiv(GL_FRAGMENT_SHADER, 2, indices);
+            glUniform2f(glGetUniformLocation(final_shader.Program, "texelSize"), 1.0f/blurWidth, 1.0f/blurHeight);
+            glUniform1i(glGetUniformLocation(final_shader.Program, "lumaTrick"), LumaTrickEnabled());
+            glUniform1i(glGetUniformLocation(final_shader.Program, "horizontalTexture"), 2);
+            // the units 4 and 5 are used by the hit mask and the depth map: the other outputs of the horizontal pass of the bokeh are bound to the units 3, 7, 8 and 9
+            const GLint bokehUnits[BOKEH_TARGETS] = {3, 7, 8, 9};
+            glUniform1iv(glGetUniformLocation(final_shader.Program, "bokehTexture"), BOKEH_TARGETS, bokehUnits);
+            for(int t = 0; t < BOKEH_TARGETS; t++){
+                glActiveTexture(GL_TEXTURE0 + bokehUnits[t]);
+                glBindTexture(GL_TEXTURE_2D, hBokehTextures[t]);
+            }
+            blurResult = hBlurTexture;
         }
         else{
-            index = glGetSubroutineIndex(mix_shader.Program, GL_FRAGMENT_SHADER, "FullBlur");
+            glUniform2f(glGetUniformLocation(final_shader.Program, "texelSize"), 1.0f/framebufferWidth, 1.0f/framebufferHeight);
+            index = glGetSubroutineIndex(final_shader.Program, GL_FRAGMENT_SHADER, mixName.c_str());
             glUniformSubroutinesuiv( GL_FRAGMENT_SHADER, 1, &index);
+            glUniform1i(glGetUniformLocation(final_shader.Program, "blurTexture"), 2);
+            glUniform1i(glGetUniformLocation(final_shader.Program, "bilateralUpsample"), halfResDof);
         }
 
-        glUniform1i(glGetUniformLocation(mix_shader.Program, "screenTexture"), 1);
-        glUniform1i(glGetUniformLocation(mix_shader.Program, "blurTexture"), 2);
+        glUniform1i(glGetUniformLocation(final_shader.Program, "screenTexture"), 1);
+        // with the pyramid, the texture unit 1 contains a downsampled level: we bind again the scene
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("sceneColor"));
         glActiveTexture(GL_TEXTURE5);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        GLint depthLocation = glGetUniformLocation(mix_shader.Program, "zmap");
+        glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("sceneDepth"));
+        GLint depthLocation = glGetUniformLocation(final_shader.Program, "zmap");
         glUniform1i(depthLocation, 5);
-        GLint frequencyLocation = glGetUniformLocation(mix_shader.Program, "frequency");
-        GLint hitPointNumberLocation = glGetUniformLocation(mix_shader.Program, "contactPointNumber");
-        GLint hitPointLocation = glGetUniformLocation(mix_shader.Program, "normalizedContactPoints");
-        GLint powersLocation = glGetUniformLocation(mix_shader.Program, "powers");
-        
-
-        GLint harmonicsLocation = glGetUniformLocation(mix_shader.Program, "harmonics");
-
-        // we assign the value to the uniform variable
-        glUniform1i(hitPointNumberLocation, hit_index);
-        glUniform1f(frequencyLocation, frequency);
-        glUniform1fv(powersLocation,MAX_HIT, powers);
-        glUniform2fv(hitPointLocation,MAX_HIT, hitPoints);
-        glUniform1f(harmonicsLocation, harmonics);
-        glUniform1i(glGetUniformLocation(mix_shader.Program, "redOverlay"), redOverlay);
-        glUniform1i(glGetUniformLocation(mix_shader.Program, "life"), life);
-        // Draw the framebuffer rectangle
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_2D, hitMaskTexture);
+        glUniform1i(glGetUniformLocation(final_shader.Program, "hitMask"), 4);
+        glUniform1i(glGetUniformLocation(final_shader.Program, "redOverlay"), redOverlay);
+        glUniform1i(glGetUniformLocation(final_shader.Program, "life"), life);
+        // Draw the framebuffer rectangle (with the fused pass, the result of the horizontal blur)
 		glActiveTexture(GL_TEXTURE2);
 		glBindVertexArray(rectVAO);
 		glDisable(GL_DEPTH_TEST); // prevents framebuffer rectangle from being discarded
-		glBindTexture(GL_TEXTURE_2D, framebufferTexture[2]);
+		glBindTexture(GL_TEXTURE_2D, blurResult);
 		glDrawArrays(GL_TRIANGLES, 0, 6);
+
+        if(renderGraph.Enabled("luminance")){
+            // histogram of the luminance of the HDR image, then average luminance, adapted to the one of the previous frames
+            luminance_shader->Use();
+            glUniform1i(glGetUniformLocation(luminance_shader->Program, "hdrTexture"), 1);
+            glUniform1f(glGetUniformLocation(luminance_shader->Program, "minLogLuminance"), MIN_LOG_LUMINANCE);
+            glUniform1f(glGetUniformLocation(luminance_shader->Program, "logLuminanceRange"), LOG_LUMINANCE_RANGE);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("hdrScreen"));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, histogramBuffer);
+            glDispatchCompute((framebufferWidth + 15) / 16, (framebufferHeight + 15) / 16, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            exposure_shader->Use();
+            glUniform1f(glGetUniformLocation(exposure_shader->Program, "minLogLuminance"), MIN_LOG_LUMINANCE);
+            glUniform1f(glGetUniformLocation(exposure_shader->Program, "logLuminanceRange"), LOG_LUMINANCE_RANGE);
+            glUniform1f(glGetUniformLocation(exposure_shader->Program, "adaptation"), 1.0f - exp(-deltaTime * EXPOSURE_ADAPTATION_SPEED));
+            glUniform1ui(glGetUniformLocation(exposure_shader->Program, "texelCount"), (GLuint)(framebufferWidth * framebufferHeight));
+            glBindImageTexture(0, averageLuminanceTexture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+            glDispatchCompute(1, 1, 1);
+            // the tonemapping samples the average luminance, and the next frame reads and writes the image and the histogram again
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+        }
+        if(renderGraph.Enabled("tonemap")){
+            renderGraph.BindFramebuffer("tonemap");
+            tonemap_shader.Use();
+            glUniform1i(glGetUniformLocation(tonemap_shader.Program, "hdrTexture"), 1);
+            glUniform1i(glGetUniformLocation(tonemap_shader.Program, "averageLuminance"), 2);
+            glUniform1i(glGetUniformLocation(tonemap_shader.Program, "autoExposure"), renderGraph.Enabled("luminance"));
+            glUniform1f(glGetUniformLocation(tonemap_shader.Program, "exposureKey"), EXPOSURE_KEY);
+            glUniform2f(glGetUniformLocation(tonemap_shader.Program, "exposureRange"), MIN_EXPOSURE, MAX_EXPOSURE);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, renderGraph.Texture("hdrScreen"));
+            glActiveTexture(GL_TEXTURE2);
+            glBindTexture(GL_TEXTURE_2D, averageLuminanceTexture);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        resolveTimers[sceneFormat].End();
         DisplayUI(text_shader);
 		// Swap the back buffer with the front buffer
 		glfwSwapBuffers(window);
+        if(firstFrame){
+            firstFrame = false;
+            cout << "First frame after " << glfwGetTime() - loadingStart << " s" << endl;
+        }
 
     }
 
@@ -745,6 +1226,34 @@ int main()
     // we delete the Shader Programs
     basic_shader.Delete();
     horizontal_blur_shader.Delete();
+    downsample_shader.Delete();
+    hitmask_shader.Delete();
+    temporal_shader.Delete();
+    fused_mix_shader.Delete();
+    upsample_shader.Delete();
+    coc_shader.Delete();
+    dof_gather_shader.Delete();
+    tonemap_shader.Delete();
+    ReleaseRenderTargets();
+    textRenderer.Release();
+    textureStreamer.Release();
+    gaussianKernel.Release();
+    bokehKernel.Release();
+    if(noiseTexture)
+        glDeleteTextures(1, &noiseTexture);
+    blurTimers[0].Release();
+    blurTimers[1].Release();
+    dofTimer.Release();
+    for(int f = 0; f < SCENE_FORMATS; f++){
+        sceneTimers[f].Release();
+        resolveTimers[f].Release();
+    }
+    if(histogramBuffer)
+        glDeleteBuffers(1, &histogramBuffer);
+    if(averageLuminanceTexture)
+        glDeleteTextures(1, &averageLuminanceTexture);
+    if(compute_blur_shader)
+        compute_blur_shader->Delete();
     // we close and delete the created context
     glfwTerminate();
     return 0;
@@ -810,7 +1319,8 @@ void PrintCurrentShader(int subroutine, vector<string> *vector)
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode)
 {
     GLuint new_subroutine;
-    if(!gameHasStart && key==GLFW_KEY_ENTER && action==GLFW_PRESS){
+    // the game can start only when the scene has been set up (= all the models are loaded)
+    if(!gameHasStart && sceneReady && key==GLFW_KEY_ENTER && action==GLFW_PRESS){
         StartGame();
         return;
     }
@@ -841,6 +1351,62 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     if(key == GLFW_KEY_O && action == GLFW_PRESS){
         pauseEnemies=!pauseEnemies;
     }
+    if(key == GLFW_KEY_R && action == GLFW_PRESS){
+        printQueueStats=true;
+    }
+    // K cycles between automatic LOD selection and forcing each LOD, to compare them
+    if(key == GLFW_KEY_K && action == GLFW_PRESS){
+        renderQueue.forcedLOD = renderQueue.forcedLOD >= 3 ? -1 : renderQueue.forcedLOD + 1;
+        if(renderQueue.forcedLOD < 0)
+            cout << "LOD: automatic" << endl;
+        else
+            cout << "LOD: forced to " << renderQueue.forcedLOD << endl;
+    }
+    // V cycles the number of components of the circular bokeh
+    if(key == GLFW_KEY_V && action == GLFW_PRESS){
+        bokehComponentCount = bokehComponentCount % BOKEH_MAX_COMPONENTS + 1;
+        cout << "Circular bokeh: " << bokehComponentCount << " components" << endl;
+    }
+    // C switches between the fragment and the compute version of the blur passes
+    if(key == GLFW_KEY_C && action == GLFW_PRESS){
+        if(computeBlurSupported){
+            computeBlur = !computeBlur;
+            cout << "Blur passes: " << (computeBlur ? "compute shader" : "fragment shaders") << endl;
+        }
+        else
+            cout << "Compute shaders are not supported (OpenGL 4.3 is needed)" << endl;
+    }
+    // G cycles the render scale of the blur chain
+    if(key == GLFW_KEY_G && action == GLFW_PRESS){
+        renderScale = renderScale <= 0.25f ? 1.0f : renderScale - 0.25f;
+        renderTargetsChanged = true;
+        cout << "Render scale of the blur: " << renderScale << endl;
+    }
+    // F enables/disables the fusion of the vertical blur with the mix pass
+    if(key == GLFW_KEY_F && action == GLFW_PRESS){
+        fusedMix = !fusedMix;
+        cout << "Vertical blur fused with the mix pass: " << (fusedMix ? "enabled" : "disabled") << endl;
+    }
+    // U cycles the format of the scene (RGBA8, RGBA16F, R11F_G11F_B10F)
+    if(key == GLFW_KEY_U && action == GLFW_PRESS){
+        sceneFormat = (sceneFormat + 1) % SCENE_FORMATS;
+        cout << "Scene format: " << sceneFormatNames[sceneFormat] << (sceneFormat > 0 ? " (HDR, with tonemapping)" : "") << endl;
+    }
+    // J enables/disables the half resolution depth of field of the Distance mix
+    if(key == GLFW_KEY_J && action == GLFW_PRESS){
+        halfResolutionDof = !halfResolutionDof;
+        cout << "Half resolution DOF of the Distance mix: " << (halfResolutionDof ? "enabled" : "disabled") << endl;
+    }
+    // T enables/disables the temporal accumulation of the blur
+    if(key == GLFW_KEY_T && action == GLFW_PRESS){
+        temporalBlur = !temporalBlur;
+        cout << "Temporal blur: " << (temporalBlur ? "enabled" : "disabled") << endl;
+    }
+    // N cycles the number of levels of the blur pyramid (0 = blur on the full size image)
+    if(key == GLFW_KEY_N && action == GLFW_PRESS){
+        pyramidLevel = (pyramidLevel + 1) % (PYRAMID_LEVELS + 1);
+        cout << "Blur pyramid: " << (pyramidLevel == 0 ? string("disabled") : "blur at 1/" + std::to_string(1 << pyramidLevel) + " resolution") << endl;
+    }
     if(key == GLFW_KEY_KP_ADD && action == GLFW_PRESS){
         life++;
         power=(100.0-life)/50.0;
@@ -899,6 +1465,22 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         keys[key] = false;
 }
 
+//////////////////////////////////////////
+// callback for the resize of the framebuffer (in pixels): the render targets are created again with the new size
+void framebuffer_size_callback(GLFWwindow* window, int width, int height)
+{
+    framebufferWidth = width;
+    framebufferHeight = height;
+    renderTargetsChanged = true;
+}
+
+// callback for the resize of the window (in screen coordinates, used for the cursor position)
+void window_size_callback(GLFWwindow* window, int width, int height)
+{
+    screenWidth = width;
+    screenHeight = height;
+}
+
 //////////////////////////////////////////
 // If one of the WASD keys is pressed, the camera is moved accordingly (the code is in utils/camera.h)
 void apply_camera_movements()
@@ -987,6 +1569,78 @@ void update_hits(float deltaTime){
     life= 100-power*50;
 }
 
+//////////////////////////////////////////
+// the hit mask is rendered again only if the hits or the parameters of the noise have changed (e.g., new hit, or power decreasing during the recovery)
+// each hit with power > 0 is rendered with a quad around it, and the hits are combined keeping the maximum (GL_MAX blending)
+void UpdateHitMask(Shader &shader, GLuint vao)
+{
+    if(!noiseReady)
+        return;
+    if(hitMaskValid && memcmp(hitMaskPowers, powers, sizeof(powers)) == 0 && memcmp(hitMaskPoints, hitPoints, sizeof(hitPoints)) == 0
+       && hitMaskFrequency == frequency && hitMaskHarmonics == harmonics)
+        return;
+    memcpy(hitMaskPowers, powers, sizeof(powers));
+    memcpy(hitMaskPoints, hitPoints, sizeof(hitPoints));
+    hitMaskFrequency = frequency;
+    hitMaskHarmonics = harmonics;
+    hitMaskValid = true;
+    hitMaskUpdates++;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, hitMaskFBO);
+    glViewport(0, 0, hitMaskWidth, hitMaskHeight);
+    const GLfloat empty[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, empty);
+    shader.Use();
+    glUniform1f(glGetUniformLocation(shader.Program, "frequency"), frequency);
+    glUniform1f(glGetUniformLocation(shader.Program, "harmonics"), harmonics);
+    glUniform1f(glGetUniformLocation(shader.Program, "extent"), HIT_MASK_EXTENT);
+    glActiveTexture(GL_TEXTURE7);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, noiseTexture);
+    glUniform1i(glGetUniformLocation(shader.Program, "noiseTexture"), 7);
+    glBlendEquation(GL_MAX);
+    glBindVertexArray(vao);
+    for(int i = 0; i < MAX_HIT; i++){
+        if(powers[i] == 0)
+            continue;
+        glUniform2f(glGetUniformLocation(shader.Program, "contactPoint"), hitPoints[2*i], hitPoints[2*i+1]);
+        glUniform1f(glGetUniformLocation(shader.Program, "power"), powers[i]);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+    glBlendEquation(GL_FUNC_ADD);
+}
+
+//////////////////////////////////////////
+// the layers of the noise are computed on a worker thread, and checked against the scalar version of snoise (there are no unit tests: the result is printed at startup)
+// the texture is created by the main thread, with mipmaps to avoid aliasing on the high octaves
+void BakeNoise()
+{
+    assetJobs.Submit([](){
+        double start = glfwGetTime();
+        std::shared_ptr<vector<float>> layers = std::make_shared<vector<float>>(NoiseBaker::Bake());
+        double bakeTime = glfwGetTime() - start;
+        float bakeError, simdError, seamError;
+        NoiseBaker::Verify(*layers, bakeError, simdError, seamError);
+        assetJobs.PostToMainThread([layers, bakeTime, bakeError, simdError, seamError](){
+            glGenTextures(1, &noiseTexture);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, noiseTexture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R16F, NOISE_SIZE, NOISE_SIZE, NOISE_OCTAVES, 0, GL_RED, GL_FLOAT, layers->data());
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+            noiseReady = true;
+            bool ok = bakeError < 1e-4f && simdError < 1e-3f && seamError < 1e-4f;
+            cout << "Noise: " << NOISE_OCTAVES << " layers of " << NOISE_SIZE << "x" << NOISE_SIZE << " baked in " << bakeTime * 1000.0 << " ms"
+#ifdef NOISE_SIMD
+                 << " (SSE2)"
+#endif
+                 << ", max error " << bakeError << ", SIMD error " << simdError << ", seam error " << seamError << (ok ? " (ok)" : " (WRONG)") << endl;
+        });
+    });
+}
+
 bool add_hit(float normx, float normy){
     if(powers[hit_index]!=0){
         return false;
@@ -1000,44 +1654,243 @@ bool add_hit(float normx, float normy){
 }
 
 ///////////////////////////////////////////
-// load one side of the cubemap, passing the name of the file and the side of the corresponding OpenGL cubemap
-void LoadTextureCubeSide(string path, string side_image, GLuint side_name)
+// creation of the render targets of the post-processing chain, with the current size of the framebuffer and render scale
+bool CreateRenderTargets()
 {
-    int w, h;
-    unsigned char* image;
-    string fullname;
-
-    // full name and path of the side of the cubemap
-    fullname = path + side_image;
-    // we load the image file
-    image = stbi_load(fullname.c_str(), &w, &h, 0, STBI_rgb);
-    if (image == nullptr)
-        std::cout << "Failed to load texture!" << std::endl;
-    // we set the image file as one of the side of the cubemap (passed as a parameter)
-    glTexImage2D(side_name, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    // we free the memory once we have created an OpenGL texture
-    stbi_image_free(image);
+    blurWidth = std::max(1, (int)(framebufferWidth * renderScale));
+    blurHeight = std::max(1, (int)(framebufferHeight * renderScale));
+
+    // the targets of the scene and of the blur chain are allocated by the render graph, when it is compiled
+
+    // hit mask (a single channel is enough), rendered again in the next frame
+    hitMaskWidth = std::max(1, (int)(framebufferWidth * HIT_MASK_SCALE));
+    hitMaskHeight = std::max(1, (int)(framebufferHeight * HIT_MASK_SCALE));
+    glGenFramebuffers(1, &hitMaskFBO);
+    glGenTextures(1, &hitMaskTexture);
+    glBindFramebuffer(GL_FRAMEBUFFER, hitMaskFBO);
+    glBindTexture(GL_TEXTURE_2D, hitMaskTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, hitMaskWidth, hitMaskHeight, 0, GL_RED, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hitMaskTexture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE){
+        std::cout << "Framebuffer of the hit mask error" << std::endl;
+        return false;
+    }
+    // the mask is empty until the first update (the mix pass reads the blurred image only where it is > 0)
+    const GLfloat emptyMask[] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, emptyMask);
+    hitMaskValid = false;
+
+    // history of the temporal blur
+    glGenFramebuffers(2, historyFBO);
+    glGenTextures(2, historyTexture);
+    for(int i = 0; i < 2; i++)
+        if(!CreateColorTarget(historyFBO[i], historyTexture[i], blurWidth, blurHeight))
+            return false;
+    historyValid = false;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return true;
 }
 
-GLint LoadTextureCube(string path,const string format= std::string("jpg"))
+// it attaches to the framebuffer a RGBA16F texture with the given size, read with bilinear filtering
+bool CreateColorTarget(GLuint fbo, GLuint texture, int width, int height, GLenum attachment)
 {
-    GLuint textureImage;
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture, 0);
+    GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (fboStatus != GL_FRAMEBUFFER_COMPLETE){
+        std::cout << "Framebuffer of the blur chain error: " << fboStatus << std::endl;
+        return false;
+    }
+    return true;
+}
 
-    // we create and activate the OpenGL cubemap texture
-    glGenTextures(1, &textureImage);
+//////////////////////////////////////////
+// passes of the frame, in the order of execution, with the targets they read and write: the passes not needed for the screen are culled by the render graph
+// the targets of the blur chain are RGBA16F, because the real and imaginary parts of the bokeh can be negative (and the compute blur writes them as images)
+void DeclareRenderGraph(bool skipBlur, bool dof, int components, bool fusedPass, bool halfResDof)
+{
+    renderGraph.Begin();
+    // the screen, and the targets managed by the application (the hit mask is rendered only when the hits change, the history is kept across the frames)
+    renderGraph.Import("screen");
+    renderGraph.Import("hitMask");
+    renderGraph.Import("history");
+
+    // only the scene is rendered at the full size, and it is the only pass with a depth buffer
+    renderGraph.Target("sceneColor", framebufferWidth, framebufferHeight, sceneFormats[sceneFormat]);
+    renderGraph.Target("sceneDepth", framebufferWidth, framebufferHeight, GL_DEPTH_COMPONENT24);
+    renderGraph.Pass("scene", {}, {"sceneColor", "sceneDepth"});
+
+    vector<string> blurInputs;
+    if(halfResDof){
+        // the half resolution depth of field replaces the blur chain (it does not depend on the render scale)
+        int w = PyramidSize(framebufferWidth, 1), h = PyramidSize(framebufferHeight, 1);
+        renderGraph.Target("cocHalf", w, h, GL_RGBA16F);
+        renderGraph.Target("dofHalf", w, h, GL_RGBA16F);
+        renderGraph.Pass("coc", {"sceneColor", "sceneDepth"}, {"cocHalf"});
+        renderGraph.Pass("dofgather", {"cocHalf"}, {"dofHalf"});
+        blurInputs.push_back("dofHalf");
+    }
+    else if(!skipBlur){
+        string source = "sceneColor";
+        for(int l = 1; l <= pyramidLevel; l++){
+            string down = "down" + std::to_string(l);
+            renderGraph.Target(down, PyramidSize(blurWidth, l), PyramidSize(blurHeight, l), GL_RGBA16F);
+            renderGraph.Pass("downsample" + std::to_string(l), {source}, {down});
+            source = down;
+        }
+
+        // with the DOF, the horizontal pass writes the real and imaginary parts of the components: 1 more target for 1 component, 2 for 2 components, 4 for 3 components
+        // (the compute blur writes all the components in a single image)
+        // with the temporal accumulation, the targets after the horizontal pass are written only in the refreshed band, so they keep their own texture
+        int w = PyramidSize(blurWidth, pyramidLevel), h = PyramidSize(blurHeight, pyramidLevel);
+        vector<string> horizontal = {"hblur"};
+        renderGraph.Target("hblur", w, h, GL_RGBA16F);
+        if(dof && computeBlur)
+            horizontal.push_back("imaginary");
+        else if(dof){
+            const int bokehTargets[] = {1, 2, 4};
+            for(int t = 0; t < bokehTargets[components - 1]; t++)
+                horizontal.push_back("bokeh" + std::to_string(t));
+        }
+        for(size_t t = 1; t < horizontal.size(); t++)
+            renderGraph.Target(horizontal[t], w, h, GL_RGBA16F);
+        renderGraph.Pass("hblur", {source}, horizontal);
+
+        if(fusedPass)
+            blurInputs = horizontal;
+        else{
+            string result = pyramidLevel > 0 ? "vblur" : "blur";
+            renderGraph.Target(result, w, h, GL_RGBA16F, temporalBlur);
+            renderGraph.Pass("vblur", horizontal, {result});
+            for(int l = pyramidLevel - 1; l >= 0; l--){
+                string up = l == 0 ? "blur" : "up" + std::to_string(l);
+                renderGraph.Target(up, PyramidSize(blurWidth, l), PyramidSize(blurHeight, l), GL_RGBA16F, temporalBlur);
+                renderGraph.Pass("upsample" + std::to_string(l), {result}, {up});
+                result = up;
+            }
+            if(temporalBlur){
+                renderGraph.Pass("temporal", {"blur", "sceneDepth", "history"}, {"history"});
+                blurInputs.push_back("history");
+            }
+            else
+                blurInputs.push_back("blur");
+        }
+    }
+
+    renderGraph.Pass("hitmask", {}, {"hitMask"});
+    vector<string> mixInputs = {"sceneColor", "sceneDepth", "hitMask"};
+    mixInputs.insert(mixInputs.end(), blurInputs.begin(), blurInputs.end());
+    if(sceneFormats[sceneFormat] == GL_RGBA8){
+        renderGraph.Pass("mix", mixInputs, {"screen"});
+    }
+    else{
+        // HDR: the result of the mix pass is tonemapped to the screen, with the auto-exposure if the compute shaders are available
+        renderGraph.Target("hdrScreen", framebufferWidth, framebufferHeight, sceneFormats[sceneFormat]);
+        renderGraph.Pass("mix", mixInputs, {"hdrScreen"});
+        vector<string> tonemapInputs = {"hdrScreen"};
+        if(computeBlurSupported){
+            renderGraph.Import("averageLuminance");
+            renderGraph.Pass("luminance", {"hdrScreen", "averageLuminance"}, {"averageLuminance"});
+            tonemapInputs.push_back("averageLuminance");
+        }
+        renderGraph.Pass("tonemap", tonemapInputs, {"screen"});
+    }
+    renderGraph.Pass("ui", {"screen"}, {"screen"});
+}
+
+//////////////////////////////////////////
+// compute version of the blur passes: horizontal pass from the source to hTexture (and imaginaryTexture, with the DOF), then vertical pass to vTexture
+// each workgroup processes BLUR_GROUP_SIZE texels of a row (or column), so we dispatch a row of workgroups for each row (or column) of the image
+#define BLUR_GROUP_SIZE 128
+void DispatchComputeBlur(Shader &shader, const string &model, GLuint source, GLuint hTexture, GLuint imaginaryTexture, GLuint vTexture, int width, int height,
+                         const vector<glm::ivec4> &hRegions, const vector<glm::ivec4> &vRegions)
+{
+    // the models have the same names of the subroutines of the fragment path
+    const string models[] = {"GaussianBlur", "NonGaussianBlur", "DOFCircular", "DOFSquare"};
+    int blurModel = (int)(std::find(models, models + 4, model) - models) % 4;
+    bool dof = blurModel >= 2;
+
+    shader.Use();
+    glUniform1i(glGetUniformLocation(shader.Program, "blurModel"), blurModel);
+    glUniform2f(glGetUniformLocation(shader.Program, "texelSize"), 1.0f/blurWidth, 1.0f/blurHeight);
+    glUniform2i(glGetUniformLocation(shader.Program, "outputSize"), width, height);
+    glUniform1i(glGetUniformLocation(shader.Program, "lumaTrick"), LumaTrickEnabled());
+    glUniform1i(glGetUniformLocation(shader.Program, "screenTexture"), 1);
+    glUniform1i(glGetUniformLocation(shader.Program, "immaginaryTexture"), 3);
+
+    // horizontal pass
+    glUniform1i(glGetUniformLocation(shader.Program, "vertical"), GL_FALSE);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, source);
+    glBindImageTexture(0, hTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    glBindImageTexture(1, imaginaryTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    // a group for each line of a rectangle, and for each GROUP_SIZE texels along the line
+    GLint originLocation = glGetUniformLocation(shader.Program, "regionOrigin");
+    for(size_t r = 0; r < hRegions.size(); r++){
+        glUniform2i(originLocation, hRegions[r].x, hRegions[r].y);
+        glDispatchCompute((hRegions[r].z + BLUR_GROUP_SIZE - 1) / BLUR_GROUP_SIZE, hRegions[r].w, 1);
+    }
+    // the vertical pass samples the images written by the horizontal pass
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+    // vertical pass
+    glUniform1i(glGetUniformLocation(shader.Program, "vertical"), GL_TRUE);
+    glBindTexture(GL_TEXTURE_2D, hTexture);
+    if(dof){
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_2D, imaginaryTexture);
+    }
+    glBindImageTexture(0, vTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+    for(size_t r = 0; r < vRegions.size(); r++){
+        glUniform2i(originLocation, vRegions[r].x, vRegions[r].y);
+        glDispatchCompute((vRegions[r].w + BLUR_GROUP_SIZE - 1) / BLUR_GROUP_SIZE, vRegions[r].z, 1);
+    }
+    // the following passes sample the result
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureImage);
+}
 
-    // we load and set the 6 images corresponding to the 6 views of the cubemap
-    // we use as convention that the names of the 6 images are "posx, negx, posy, negy, posz, negz", placed at the path passed as parameter
-    // we load the images individually and we assign them to the correct sides of the cube map
-    LoadTextureCubeSide(path, std::string("posx.")+format, GL_TEXTURE_CUBE_MAP_POSITIVE_X);
-    LoadTextureCubeSide(path, std::string("negx.")+format, GL_TEXTURE_CUBE_MAP_NEGATIVE_X);
-    LoadTextureCubeSide(path, std::string("posy.")+format, GL_TEXTURE_CUBE_MAP_POSITIVE_Y);
-    LoadTextureCubeSide(path, std::string("negy.")+format, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y);
-    LoadTextureCubeSide(path, std::string("posz.")+format, GL_TEXTURE_CUBE_MAP_POSITIVE_Z);
-    LoadTextureCubeSide(path, std::string("negz.")+format, GL_TEXTURE_CUBE_MAP_NEGATIVE_Z);
+void ReleaseRenderTargets()
+{
+    renderGraph.Release();
+    glDeleteFramebuffers(1, &hitMaskFBO);
+    glDeleteTextures(1, &hitMaskTexture);
+    glDeleteFramebuffers(2, historyFBO);
+    glDeleteTextures(2, historyTexture);
+}
+
+///////////////////////////////////////////
+// CPU data of the 6 sides of the cubemap, decoded on the worker threads
+struct CubeMapData {
+    int width[6], height[6];
+    unsigned char* images[6];
+    // sides still to decode: the last job to finish posts the upload to the main thread
+    int remaining;
+    std::mutex mutex;
+};
 
+// upload of one side of the cubemap, passing the decoded image and the side of the corresponding OpenGL cubemap
+void LoadTextureCubeSide(int w, int h, unsigned char* image, GLuint side_name)
+{
+    // we set the image file as one of the side of the cubemap (passed as a parameter)
+    glTexImage2D(side_name, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+}
+
+// parameters of the cube map currently bound
+void SetTextureCubeParameters()
+{
     // we set the filtering for minification and magnification
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -1046,10 +1899,157 @@ GLint LoadTextureCube(string path,const string format= std::string("jpg"))
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+}
+
+// the decoded sides are streamed (see textureStreamer.h) in a new cube map, which replaces the placeholder when all the sides have been uploaded
+void StreamTextureCube(std::shared_ptr<CubeMapData> data, GLuint placeholder)
+{
+    std::shared_ptr<unsigned char> images[6];
+    bool valid = true;
+    for(int s = 0; s < 6; s++){
+        // we free the memory once the side has been uploaded
+        images[s] = std::shared_ptr<unsigned char>(data->images[s], stbi_image_free);
+        valid = valid && data->images[s] != nullptr && data->width[s] == data->width[0] && data->height[s] == data->height[0];
+    }
+    // the sides must have the same size to have a complete cube map: otherwise, we keep the placeholder
+    if(!valid){
+        std::cout << "Failed to load the cube map!" << std::endl;
+        return;
+    }
+
+    GLuint streamed;
+    glGenTextures(1, &streamed);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, streamed);
+    for(int s = 0; s < 6; s++)
+        LoadTextureCubeSide(data->width[s], data->height[s], NULL, GL_TEXTURE_CUBE_MAP_POSITIVE_X + s);
+    SetTextureCubeParameters();
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    std::shared_ptr<int> remaining = std::make_shared<int>(6);
+    for(int s = 0; s < 6; s++){
+        TextureUpload u;
+        u.texture = streamed;
+        u.bindTarget = GL_TEXTURE_CUBE_MAP;
+        u.target = GL_TEXTURE_CUBE_MAP_POSITIVE_X + s;
+        u.level = 0;
+        u.width = data->width[s];
+        u.height = data->height[s];
+        u.format = GL_RGB;
+        u.type = GL_UNSIGNED_BYTE;
+        u.bytesPerPixel = 3;
+        u.pixels = images[s];
+        u.onComplete = [remaining, streamed, placeholder](){
+            if(--(*remaining) > 0)
+                return;
+            textureCube = streamed;
+            glDeleteTextures(1, &placeholder);
+        };
+        textureStreamer.Enqueue(u);
+    }
+}
+
+// the compressed cube map (see work/texcompress) is uploaded with all its mip levels in a new cube map, which replaces the placeholder
+// it returns false if the file does not contain a complete BC7 cube map
+bool UploadCompressedTextureCube(const CompressedTexture& tex, GLuint placeholder)
+{
+    if(tex.faces != 6 || tex.internalFormat != GL_COMPRESSED_RGBA_BPTC_UNORM || tex.width != tex.height)
+        return false;
+
+    // errors of the previous calls, not related to the upload
+    while(glGetError() != GL_NO_ERROR);
+
+    GLuint compressed;
+    glGenTextures(1, &compressed);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, compressed);
+    // the blocks are already in the final format: the driver copies them as they are, without any conversion
+    for(int l = 0; l < tex.levels; l++){
+        GLsizei size = std::max(1, tex.width >> l);
+        for(int s = 0; s < 6; s++){
+            const vector<unsigned char>& image = tex.Image(l, s);
+            glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + s, l, tex.internalFormat, size, size, 0, (GLsizei)image.size(), &image[0]);
+        }
+    }
+    // if the driver rejects the data, the cube map is incomplete: we keep the placeholder, and the source images are decoded
+    if(glGetError() != GL_NO_ERROR){
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        glDeleteTextures(1, &compressed);
+        return false;
+    }
+    SetTextureCubeParameters();
+    // we use the mip levels stored in the file
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, tex.levels - 1);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    textureCube = compressed;
+    glDeleteTextures(1, &placeholder);
+    return true;
+}
+
+// we decode the 6 images on the worker threads, and we assign them to the correct sides of the cube map when all of them are available
+// (the sides must have the same size to have a complete cube map)
+void DecodeTextureCube(string path, const string format, GLuint placeholder)
+{
+    // we use as convention that the names of the 6 images are "posx, negx, posy, negy, posz, negz", placed at the path passed as parameter
+    const char* sides[6] = {"posx.", "negx.", "posy.", "negy.", "posz.", "negz."};
+
+    std::shared_ptr<CubeMapData> data = std::make_shared<CubeMapData>();
+    data->remaining = 6;
+    for(int i = 0; i < 6; i++){
+        string fullname = path + sides[i] + format;
+        assetJobs.Submit([data, i, fullname, placeholder](){
+            // we load the image file
+            data->images[i] = stbi_load(fullname.c_str(), &data->width[i], &data->height[i], 0, STBI_rgb);
+            if (data->images[i] == nullptr)
+                std::cout << "Failed to load texture!" << std::endl;
+            std::lock_guard<std::mutex> lock(data->mutex);
+            if(--data->remaining > 0)
+                return;
+            assetJobs.PostToMainThread([data, placeholder](){
+                StreamTextureCube(data, placeholder);
+            });
+        });
+    }
+}
+
+GLint LoadTextureCube(string path,const string format= std::string("jpg"))
+{
+    GLuint textureImage;
+
+    // we create and activate the OpenGL cubemap texture
+    glGenTextures(1, &textureImage);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textureImage);
+
+    // until the images are loaded, each side is a single texel with the clear color
+    unsigned char placeholder[3] = {66, 117, 250};
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(int i = 0; i < 6; i++)
+        LoadTextureCubeSide(1, 1, placeholder, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+    SetTextureCubeParameters();
 
     // we set the binding to 0 once we have finished
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
+    // if the compressed version of the cube map is available, we read it on a worker thread, and we use it instead of the images
+    string compressedName = path + "cubemap.ktx";
+    if(ifstream(compressedName.c_str()).good()){
+        assetJobs.Submit([path, format, compressedName, textureImage](){
+            std::shared_ptr<CompressedTexture> tex = std::make_shared<CompressedTexture>();
+            bool read = TextureCompressor::ReadKTX(compressedName, *tex);
+            assetJobs.PostToMainThread([path, format, tex, read, textureImage](){
+                if(read && UploadCompressedTextureCube(*tex, textureImage))
+                    return;
+                std::cout << "Invalid compressed cube map, loading the images" << std::endl;
+                DecodeTextureCube(path, format, textureImage);
+            });
+        });
+    }
+    else
+        DecodeTextureCube(path, format, textureImage);
+
     return textureImage;
 
 }
@@ -1237,74 +2237,17 @@ void checkForCollision(){
 }
 
 int SetupFreetype(Shader &text_shader){
-    FT_Library ft;
-    if (FT_Init_FreeType(&ft))
-    {
-        std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
-        return -1;
-    }
-
-    FT_Face face;
-    if (FT_New_Face(ft, "../../fonts/Bangers.ttf", 0, &face))
-    {
-        std::cout << "ERROR::FREETYPE: Failed to load font" << std::endl;  
-        return -1;
-    }
-
-    FT_Set_Pixel_Sizes(face, 0, 48);  
-    glActiveTexture(GL_TEXTURE0);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // disable byte-alignment restriction
-  
-    for (unsigned char c = 0; c < 128; c++)
-    {
-        // load character glyph 
-        if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-        {
-            std::cout << "ERROR::FREETYTPE: Failed to load Glyph" << std::endl;
-            continue;
-        }
-        // generate texture
-        unsigned int texture;
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0,
-            GL_RED,
-            GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-        // set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        // now store character for later use
-        Character character = {
-            texture, 
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            face->glyph->advance.x
-        };
-        Characters.insert(std::pair<char, Character>(c, character));
-    }
-
-    FT_Done_Face(face);
-    FT_Done_FreeType(ft);
-
-    glGenVertexArrays(1, &textVAO);
-    glGenBuffers(1, &textVBO);
-    glBindVertexArray(textVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);   
+    // the glyphs are rendered on a worker thread, and the atlas is uploaded when ready
+    assetJobs.Submit([](){
+        std::shared_ptr<GlyphAtlas> atlas = std::make_shared<GlyphAtlas>();
+        if(!TextRenderer::RasterizeFont("../../fonts/Bangers.ttf", *atlas))
+            return;
+        assetJobs.PostToMainThread([atlas](){
+            textRenderer.SetAtlas(atlas, textureStreamer);
+        });
+    });
+
+    textRenderer.Init();
     text_shader.Use();
     glm::mat4 p2 = glm::ortho(0.0f, float(screenWidth), 0.0f, float(screenHeight));
     glUniformMatrix4fv(glGetUniformLocation(text_shader.Program, "projection"), 1, GL_FALSE, glm::value_ptr(p2));
@@ -1312,79 +2255,29 @@ int SetupFreetype(Shader &text_shader){
 
 }
 
-void RenderText(Shader &s, std::string text, float x, float y, float scale, glm::vec3 color, textPosition alignment)
+// the string is only laid out: the text of the frame is drawn at the end of DisplayUI
+void RenderText(std::string text, float x, float y, float scale, glm::vec3 color, textPosition alignment)
 {
-    // activate corresponding render state	
-    s.Use();
-    glUniform3f(glGetUniformLocation(s.Program, "textColor"), color.x, color.y, color.z);
-    glUniform1i(glGetUniformLocation(s.Program, "text"), 6);
-    glActiveTexture(GL_TEXTURE6);
-    glBindVertexArray(textVAO);
-
-    // iterate through all characters
-    std::string::const_iterator c;
-    float l=0;
-    if(alignment!=TEXT_ALIGN_LEFT){
-        for (c = text.begin(); c != text.end(); c++)
-        {
-            Character ch = Characters[*c];
-            l += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-        }
-        switch (alignment)
-        {
-        case TEXT_ALIGN_CENTER:
-            x=x-l/2;
-            break;
-        case TEXT_ALIGN_RIGHT:
-            x=x-l;
-        default:
-            break;
-        }
-    }
-
-    for (c = text.begin(); c != text.end(); c++)
-    {
-        Character ch = Characters[*c];
-
-        float xpos = x + ch.Bearing.x * scale;
-        float ypos = y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        float w = ch.Size.x * scale;
-        float h = ch.Size.y * scale;
-        // update VBO for each character
-        float vertices[6][4] = {
-            { xpos,     ypos + h,   0.0f, 0.0f },            
-            { xpos,     ypos,       0.0f, 1.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-
-            { xpos,     ypos + h,   0.0f, 0.0f },
-            { xpos + w, ypos,       1.0f, 1.0f },
-            { xpos + w, ypos + h,   1.0f, 0.0f }           
-        };
-        // render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.TextureID);
-        // update content of VBO memory
-        glBindBuffer(GL_ARRAY_BUFFER, textVBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices); 
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
-        // render quad
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        // now advance cursors for next glyph (note that advance is number of 1/64 pixels)
-        x += (ch.Advance >> 6) * scale; // bitshift by 6 to get value in pixels (2^6 = 64)
-    }
-    glBindVertexArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    textRenderer.AddText(text, x, y, scale, color, alignment);
 }
 
 void LoadModels(){
-    Model *cubeModel= new Model("../../models/cube.obj");
-    Model *sphereModel= new Model("../../models/sphere.obj");
-    Model *bunnyModel= new Model("../../models/bunny_lp.obj");
-    models.at(CUBE_MODEL)=cubeModel;
-    cout<<"all ok 2"<<endl;
-    models[SPHERE_MODEL]=sphereModel;
-    models[BUNNY_MODEL]=bunnyModel;
-
+    // the models are empty placeholders: their data are imported on the worker threads, and uploaded by the main thread
+    const string paths[3] = {"../../models/cube.obj", "../../models/sphere.obj", "../../models/bunny_lp.obj"};
+    const int slots[3] = {CUBE_MODEL, SPHERE_MODEL, BUNNY_MODEL};
+    for(int i = 0; i < 3; i++){
+        Model *model = new Model();
+        models.at(slots[i]) = model;
+        pendingModels++;
+        string path = paths[i];
+        assetJobs.Submit([model, path](){
+            std::shared_ptr<vector<MeshData> > data = std::make_shared<vector<MeshData> >(Model::Import(path));
+            assetJobs.PostToMainThread([model, data](){
+                model->Upload(*data);
+                pendingModels--;
+            });
+        });
+    }
 }
 
 void SetupScene(){
@@ -1468,17 +2361,18 @@ void UpdateEnemies(int frame){
 void DisplayUI(Shader &text_shader){
     if(!gameHasStart){
         if(gameOver){
-            RenderText(text_shader, "GAME OVER", 400.0f, 350.0f, 2.0f, glm::vec3(1, 0.15f, 0.2f), TEXT_ALIGN_CENTER);
-            RenderText(text_shader, "score:", 400.0f, 300.0f, .7f, glm::vec3(.15, .2f, 0.92f), TEXT_ALIGN_CENTER);
-            RenderText(text_shader, std::to_string(score), 400.0f, 225.0f, 2.0f, glm::vec3(.15, .2f, 0.92f), TEXT_ALIGN_CENTER);
+            RenderText("GAME OVER", 400.0f, 350.0f, 2.0f, glm::vec3(1, 0.15f, 0.2f), TEXT_ALIGN_CENTER);
+            RenderText("score:", 400.0f, 300.0f, .7f, glm::vec3(.15, .2f, 0.92f), TEXT_ALIGN_CENTER);
+            RenderText(std::to_string(score), 400.0f, 225.0f, 2.0f, glm::vec3(.15, .2f, 0.92f), TEXT_ALIGN_CENTER);
         }
-        RenderText(text_shader, "Press enter to start the game!", 400.0f, 150.0f, 1.0f, glm::vec3(1, .8f, 0.2f), TEXT_ALIGN_CENTER);
+        RenderText("Press enter to start the game!", 400.0f, 150.0f, 1.0f, glm::vec3(1, .8f, 0.2f), TEXT_ALIGN_CENTER);
     }else{
-            RenderText(text_shader, "LIFE: "+std::to_string(life), 780.0f, 550.0f, .7f, glm::vec3(1, 0.15f, 0.2f), TEXT_ALIGN_RIGHT);
-            RenderText(text_shader, "LEVEL "+std::to_string(level+1), 400.0f, 550.0f, .7f, glm::vec3(1, .8f, 0.9f), TEXT_ALIGN_CENTER);
-            RenderText(text_shader, std::to_string(score), 20.0f, 550.0f, .7f, glm::vec3(1, .8f, 0.2f), TEXT_ALIGN_LEFT);
+            RenderText("LIFE: "+std::to_string(life), 780.0f, 550.0f, .7f, glm::vec3(1, 0.15f, 0.2f), TEXT_ALIGN_RIGHT);
+            RenderText("LEVEL "+std::to_string(level+1), 400.0f, 550.0f, .7f, glm::vec3(1, .8f, 0.9f), TEXT_ALIGN_CENTER);
+            RenderText(std::to_string(score), 20.0f, 550.0f, .7f, glm::vec3(1, .8f, 0.2f), TEXT_ALIGN_LEFT);
     }
-    RenderText(text_shader, "FPS: " +std::to_string(fps), 700.0f, 25.0f, .4F, glm::vec3(0.5, 0.8f, 0.2f));
+    RenderText("FPS: " +std::to_string(fps), 700.0f, 25.0f, .4F, glm::vec3(0.5, 0.8f, 0.2f));
+    textRenderer.Draw(text_shader.Program, GL_TEXTURE6);
 
 }
 
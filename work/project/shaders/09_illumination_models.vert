@@ -22,6 +22,14 @@ layout (location = 1) in vec3 normal;
 // the numbers used for the location in the layout qualifier are the positions of the vertex attribute
 // as defined in the Mesh class
 
+// if true, the vertices use the compact format of the Mesh class (PackedVertex):
+// - position is quantized in [0,1] inside the bounding box of the mesh
+// - normal is octahedral encoded in the xy components
+uniform bool packedVertices;
+// dequantization of the position (extent and minimum corner of the bounding box, or 1 and 0 for not packed vertices)
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
 // model matrix
 uniform mat4 modelMatrix;
 // view matrix
@@ -48,17 +56,31 @@ out vec3 vNormal;
 out vec3 vViewPosition;
 
 
+// decoding of an octahedral encoded unit vector (see Mesh::octEncode)
+vec3 octDecode(vec2 e)
+{
+  vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+  // the lower half of the octahedron was folded on the upper one
+  float t = max(-n.z, 0.0);
+  n.x += (n.x >= 0.0) ? -t : t;
+  n.y += (n.y >= 0.0) ? -t : t;
+  return normalize(n);
+}
+
 void main(){
 
+  vec3 vPosition = position * positionScale + positionOffset;
+  vec3 vNormalModel = packedVertices ? octDecode(normal.xy) : normal;
+
   // vertex position in ModelView coordinate (see the last line for the application of projection)
   // when I need to use coordinates in camera coordinates, I need to split the application of model and view transformations from the projection transformations
-  vec4 mvPosition = viewMatrix * modelMatrix * vec4( position, 1.0 );
+  vec4 mvPosition = viewMatrix * modelMatrix * vec4( vPosition, 1.0 );
   
   // view direction, negated to have vector from the vertex to the camera
   vViewPosition = -mvPosition.xyz;
 
   // transformations are applied to the normal
-  vNormal = normalize( normalMatrix * normal );
+  vNormal = normalize( normalMatrix * vNormalModel );
 
   // light incidence direction (in view coordinate)
   vec4 lightPos = viewMatrix  * vec4(pointLightPosition, 1.0);
@@ -0,0 +1,39 @@
+#version 410 core
+
+// first pass of the half resolution depth of field of the Distance mix: the scene is downsampled to half resolution, and the circle of confusion (CoC) is computed from the depth
+// the CoC follows the model of the Distance subroutine of mix.frag: 0 in front of the death zone, 1 (the largest radius) inside it, with a ramp of transition_space
+
+#define transition_space 0.10
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+uniform sampler2D screenTexture;
+uniform sampler2D zmap;
+uniform int life;
+// size of the texels of the scene (at full resolution)
+uniform vec2 sourceTexelSize;
+
+// normalized CoC of a depth (it is multiplied by the largest radius in the gather pass)
+float CircleOfConfusion(float z){
+  float depth=clamp((z-.98)*50.,0.0,1.0);
+  float deathZone= float(life)/100.0;
+  if(depth>deathZone){
+    return 1.0;
+  }
+  if(depth> deathZone-transition_space &&deathZone!=1){
+    return (depth-(deathZone-transition_space))/transition_space;
+  }
+  return 0.0;
+}
+
+void main()
+{
+  // the output texel covers 2x2 texels of the scene: the bilinear filtering averages their color, and the CoC is the largest of the 4,
+  // so the blurred background is not shrunk at the edges of the objects in focus
+  vec2 d = sourceTexelSize * 0.5;
+  vec3 color = texture(screenTexture, texCoords).rgb;
+  float coc = max(max(CircleOfConfusion(texture(zmap, texCoords + vec2(-d.x, -d.y)).r), CircleOfConfusion(texture(zmap, texCoords + vec2(d.x, -d.y)).r)),
+                  max(CircleOfConfusion(texture(zmap, texCoords + vec2(-d.x, d.y)).r), CircleOfConfusion(texture(zmap, texCoords + vec2(d.x, d.y)).r)));
+  FragColor = vec4(color, coc);
+}
@@ -0,0 +1,53 @@
+#version 410 core
+
+// second pass of the half resolution depth of field of the Distance mix: each texel gathers the texels inside its circle of confusion (CoC),
+// with the samples on a golden angle spiral, and a number of samples proportional to the area of the circle (the texels in focus read only themselves)
+// the samples are split in two fields:
+// - far field: samples with a CoC >= the CoC of the texel, behind it, spread over the texel by its own CoC
+// - near field: samples with a smaller CoC, in front of the texel, which reach it only if their own CoC covers the distance
+// thus, the objects in focus do not bleed into the blurred background
+
+#define GOLDEN_ANGLE 2.39996323
+#define PI 3.14159265
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+// scene at half resolution, with the normalized CoC in the alpha channel (coc.frag)
+uniform sampler2D cocTexture;
+// size of the texels of the half resolution targets
+uniform vec2 texelSize;
+// radius (in texels) of a CoC equal to 1
+uniform float maxRadius;
+// samples for each square texel of the circle, and largest number of samples
+uniform float sampleDensity;
+uniform int maxSamples;
+
+void main()
+{
+  vec4 center = textureLod(cocTexture, texCoords, 0.0);
+  float radius = center.a * maxRadius;
+  if(radius < 0.5){
+    FragColor = center;
+    return;
+  }
+
+  int count = min(maxSamples, int(ceil(PI * radius * radius * sampleDensity)));
+  vec4 far = vec4(center.rgb, 1.0);
+  vec4 near = vec4(0.0);
+  for(int i = 0; i < count; i++){
+    float r = radius * sqrt((float(i) + 0.5) / float(count));
+    float theta = float(i) * GOLDEN_ANGLE;
+    // the loop has a different length for each texel: we read the level 0 explicitly
+    vec4 s = textureLod(cocTexture, texCoords + r * vec2(cos(theta), sin(theta)) * texelSize, 0.0);
+    if(s.a >= center.a)
+      far += vec4(s.rgb, 1.0);
+    else{
+      // the edge of the CoC of the sample is smoothed over 1 texel
+      float coverage = clamp(s.a * maxRadius - r + 1.0, 0.0, 1.0);
+      near += vec4(s.rgb, 1.0) * coverage;
+    }
+  }
+  // the CoC of the texel is kept, for the bilateral upsampling in the mix pass
+  FragColor = vec4((far.rgb + near.rgb) / (far.a + near.a), center.a);
+}
@@ -0,0 +1,22 @@
+#version 410 core
+
+// downsampling of an image to half resolution, for the blur pyramid (dual filter, Kawase style)
+// the 4 diagonal samples are placed at the corners of the output texel, so the bilinear filtering averages 4 texels of the source for each of them
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+// image to downsample, and size of its texels
+uniform sampler2D sourceTexture;
+uniform vec2 sourceTexelSize;
+
+void main()
+{
+  vec2 d = sourceTexelSize;
+  vec4 color = texture(sourceTexture, texCoords) * 4.0;
+  color += texture(sourceTexture, texCoords + vec2(-d.x, -d.y));
+  color += texture(sourceTexture, texCoords + vec2( d.x, -d.y));
+  color += texture(sourceTexture, texCoords + vec2(-d.x,  d.y));
+  color += texture(sourceTexture, texCoords + vec2( d.x,  d.y));
+  FragColor = color / 8.0;
+}
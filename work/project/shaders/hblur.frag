@@ -1,26 +1,46 @@
 #version 420 core
 
 #define BLUR_SIZE 15
-#define width 800
-#define heigth 600
 
-out vec4 FragColor;
+// with the DOF, the horizontal pass writes in a single draw the real and imaginary parts of the components of the bokeh (packed 2 channels per complex value):
+// 0 = red and green of component 0, 1 = blue of components 0 and 1, 2 = red and green of component 1, 3 = red and green of component 2, 4 = blue of component 2
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 BokehColor1;
+layout (location = 2) out vec4 BokehColor2;
+layout (location = 3) out vec4 BokehColor3;
+layout (location = 4) out vec4 BokehColor4;
 in vec2 texCoords;
 
 
-//uniform int width;
-//uniform float heigth;
+// distance between two texels of the texture to sample (it depends on the size of the render targets)
+uniform vec2 texelSize;
 
 // texture with the original rendering
 uniform sampler2D screenTexture;
 uniform bool lumaTrick;
 
 vec2 getTexelUnit(){
-  vec2 pippo= vec2(1./width,1./heigth);
-  return pippo;
+  return texelSize;
 }
 
-float gaussianCoeff[31]={0.000012413329783081219,0.000040221571373342736,0.00012017860724662446,0.00033112430318893985,0.0008412952716973684,0.001971045418358334,0.004258265431659228,0.00848309004949083,0.015583274226409627,0.026396471051462745,0.04123028152882454,0.05938436230593951,0.07887067758612198,0.09659333160297948,0.10908490810935616,0.11359811921221667,0.10908490810935616,0.09659333160297948,0.07887067758612198,0.05938436230593951,0.04123028152882454,0.026396471051462745,0.015583274226409627,0.00848309004949083,0.004258265431659228,0.001971045418358334,0.0008412952716973684,0.00033112430318893985,0.00012017860724662446,0.000040221571373342736,0.000012413329783081219};
+// linear Gaussian kernel, generated on the CPU (gaussianKernel.h): x = offset in texels, y = weight
+// the first tap is the center, the others are fetched on both sides, between two texels (the bilinear filtering returns their weighted sum)
+#define GAUSSIAN_MAX_TAPS 32
+layout (std140, binding = 0) uniform GaussianKernel {
+  int tapCount;
+  int radius;
+  vec4 taps[GAUSSIAN_MAX_TAPS];
+  vec4 weights[GAUSSIAN_MAX_TAPS / 2];
+};
+// kernels of the components of DOFCircular, generated on the CPU (bokehKernel.h): kernel[c * KERNEL_SIZE + i].xy = real and imaginary part of the tap i of the component c
+#define MAX_COMPONENTS 3
+#define KERNEL_SIZE (2 * BLUR_SIZE + 1)
+layout (std140, binding = 1) uniform BokehKernel {
+  int components;
+  vec4 componentWeights[MAX_COMPONENTS];
+  vec4 kernel[MAX_COMPONENTS * KERNEL_SIZE];
+};
+// DOFSquare uses a single component, with the bracketed kernel of this table
 const vec4 Kernel0BracketsRealXY_ImZW = vec4(-0.000776,0.680418,0.000000,0.302524);
 const vec2 Kernel0Weights_RealX_ImY = vec2(0.767583,1.862321);
 const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
@@ -56,7 +76,6 @@ const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
         vec4(/*XY: Non Bracketed*/0.002486,0.015868,/*Bracketed WZ:*/0.004794,0.052452),
         vec4(/*XY: Non Bracketed*/-0.000776,0.014351,/*Bracketed WZ:*/0.000000,0.047438)
 );
-//float gaussianCoeff[61]={0.00047108753187090845,0.0006299954542634891,0.0008342476118513276,0.0010938911084409344,0.0014202820421456586,0.0018259812420950796,0.0023245510069993323,0.002930237054811048,0.00365752422443188,0.004520561042608063,0.005532457051297556,0.0067044675016952465,0.008045092096580709,0.009559127051781698,0.011246721745323141,0.013102501343509586,0.015114823683117182,0.017265241071896104,0.019528234511337204,0.021871278517810892,0.02425527914005976,0.02663540650524366,0.02896231750779124,0.031183735942891172,0.03324632882505008,0.03509779144363722,0.03668903252214707,0.037976337009618694,0.03892337931271162,0.03950296513759527,0.03969824751877432,0.03950296513759527,0.03892337931271162,0.037976337009618694,0.03668903252214707,0.03509779144363722,0.03324632882505008,0.031183735942891172,0.02896231750779124,0.02663540650524366,0.02425527914005976,0.021871278517810892,0.019528234511337204,0.017265241071896104,0.015114823683117182,0.013102501343509586,0.011246721745323141,0.009559127051781698,0.008045092096580709,0.0067044675016952465,0.005532457051297556,0.004520561042608063,0.00365752422443188,0.002930237054811048,0.0023245510069993323,0.0018259812420950796,0.0014202820421456586,0.0010938911084409344,0.0008342476118513276,0.0006299954542634891,0.00047108753187090845};
 /////////////////////////////////////////////////////////////////////
 // we must copy and paste the code inside our shaders
 // it is not possible to include or to link an external file
@@ -74,7 +93,7 @@ const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
 ////////////////////////////////////////////////////////////////////
 
 // the "type" of the Subroutine
-subroutine vec3 blur_model();
+subroutine vec4 blur_model();
 
 // Subroutine Uniform (it is conceptually similar to a C pointer function)
 subroutine uniform blur_model Blur_Model;
@@ -88,21 +107,18 @@ vec3 lumaCorrection(vec3 pixel){
 
 
 subroutine(blur_model)
-vec3 GaussianBlur(){
+vec4 GaussianBlur(){
   vec2 unit=getTexelUnit();
-  vec4 color=vec4(0);
-  
-  for(int i=0;i<=2*BLUR_SIZE;i++ ){
-    float x_offset=((i-BLUR_SIZE)*unit.x);
-    //float x_offset=texCoords.x+((float)(i-BLUR_SIZE)*unit.x);
-    vec2 offset= vec2(x_offset,0.0);
-    color+=texture(screenTexture, texCoords.st+offset)*gaussianCoeff[i];
+  vec4 color=texture(screenTexture, texCoords.st)*taps[0].y;
+  for(int i=1;i<tapCount;i++){
+    vec2 offset=vec2(taps[i].x*unit.x,0.0);
+    color+=(texture(screenTexture, texCoords.st+offset)+texture(screenTexture, texCoords.st-offset))*taps[i].y;
   }
-  return vec3(color);
+  return vec4(vec3(color),1);
 }
 
 subroutine(blur_model)
-vec3 NonGaussianBlur(){
+vec4 NonGaussianBlur(){
   vec2 unit=getTexelUnit();
   vec4 color=vec4(0);
   int lineSize=(2*BLUR_SIZE)+1;
@@ -112,15 +128,15 @@ vec3 NonGaussianBlur(){
     vec2 offset= vec2(x_offset,0.0);
     color+=texture(screenTexture, texCoords.st+offset);
   }
-  return vec3(color)*(1.0f/float(lineSize));
+  return vec4(vec3(color)*(1.0f/float(lineSize)),1);
 }
 
-subroutine(blur_model)
-vec3 DOFCircular(){
-    //real part only
+// horizontal pass of the bokeh: each texel (real) is multiplied by the complex kernel of each component
+vec4 bokehHorizontal(bool square){
     vec2 unit = getTexelUnit();
-    vec3 val = vec3(0.,0.,0.);
-    float filterRadius = BLUR_SIZE;
+    int count = square ? 1 : components;
+    vec4 redGreen[MAX_COMPONENTS] = vec4[](vec4(0.0), vec4(0.0), vec4(0.0));
+    vec2 blue[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0));
     for (int i=-BLUR_SIZE; i <=BLUR_SIZE; ++i)
     {
         vec2 coords = texCoords + unit*vec2(float(i),0.0);
@@ -128,33 +144,31 @@ vec3 DOFCircular(){
         if(lumaTrick){
           imageTexel=lumaCorrection(imageTexel);
         }
-        float c0r = Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].x;
-        val += imageTexel * c0r;
+        for (int c=0; c<count; c++)
+        {
+            vec2 c0 = square ? Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].zw : kernel[c*KERNEL_SIZE+i+BLUR_SIZE].xy;
+            redGreen[c] += vec4(imageTexel.r*c0, imageTexel.g*c0);
+            blue[c] += imageTexel.b*c0;
+        }
     }
-    return val;
+    BokehColor1 = vec4(blue[0], blue[1]);
+    BokehColor2 = redGreen[1];
+    BokehColor3 = redGreen[2];
+    BokehColor4 = vec4(blue[2], 0.0, 0.0);
+    return redGreen[0];
 }
 
 subroutine(blur_model)
-vec3 DOFSquare(){
-    //real part only
-    vec2 unit = getTexelUnit();
-    vec3 val = vec3(0.,0.,0.);
-    float filterRadius = BLUR_SIZE;
-    for (int i=-BLUR_SIZE; i <=BLUR_SIZE; ++i)
-    {
-        vec2 coords = texCoords + unit*vec2(float(i),0.0);
-        vec3 imageTexel = vec3(texture(screenTexture, coords));
-        if(lumaTrick){
-          imageTexel=lumaCorrection(imageTexel);
-        }
-        float c0r = Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].z;
-        val += imageTexel * c0r;
-    }
-    return val;
+vec4 DOFCircular(){
+    return bokehHorizontal(false);
+}
+
+subroutine(blur_model)
+vec4 DOFSquare(){
+    return bokehHorizontal(true);
 }
 
 void main()
 {
-  vec3 blur=Blur_Model();
-  FragColor = vec4(blur,1);
+  FragColor = Blur_Model();
 }
\ No newline at end of file
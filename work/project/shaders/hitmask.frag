@@ -0,0 +1,82 @@
+#version 410 core
+
+// hit mask: each hit is splatted with a quad covering the area it can affect (see hitmask.vert), and the mask is combined with the other hits with a GL_MAX blending
+// the Splash subroutine of mix.frag reads only the mask, so its cost does not depend on the number of hits
+
+#define MAX_OFFSET 0.1
+
+out vec4 FragColor;
+// position in the texture coordinates of the screen
+in vec2 texCoords;
+
+// force and power of noise
+uniform float frequency;
+
+// number of octaves to create and sum
+uniform float harmonics;
+
+// position of the hit (in texture coordinates) and its power
+uniform vec2 contactPoint;
+uniform float power;
+
+// the noise is baked on the CPU (see include/utils/noiseBaker.h): the layer k of the array contains the sum of the first k + 1 octaves of the simplex noise,
+// tileable with period NOISE_PERIOD (in units of the noise), so all the octaves are read with a single fetch
+#define NOISE_PERIOD 8.0
+#define NOISE_OCTAVES 5
+uniform sampler2DArray noiseTexture;
+
+float fbm(vec2 position, int octaves)
+{
+  return texture(noiseTexture, vec3(position / NOISE_PERIOD, float(clamp(octaves, 1, NOISE_OCTAVES) - 1))).r;
+}
+
+////////////////////////////////////////////////////////////////////
+// aastep function calculates the length of the gradient given from the difference between the current fragment and the neighbours on the right and on the top. 
+// We can then apply a smoothstep function using as threshold the value given by the gradient.
+float aastep(float threshold, float value) {
+  float afwidth = 0.7 * length(vec2(dFdx(value), dFdy(value)));
+
+  return smoothstep(threshold-afwidth, threshold+afwidth, value);
+}
+////////////////////////////////////////////////////////////////////
+
+
+int TurbulenceAAstep(float power, vec2 pos,int t)
+{
+
+  float f = frequency*t;
+  // the harmonics are summed in the layers of the texture (a fractional number of harmonics is rounded up, like in the loop over the octaves)
+  float value = power*fbm((texCoords+pos)*f, int(ceil(harmonics)));
+
+  // we apply aastep to the turbulence result to obtain a "cow skin" effect
+  float keep = aastep(0.05,value);
+  if(keep<0.5){
+    return 0;
+  }
+ /* if(keep!=1.){
+  return vec4(1.0,0.0,0.0,1.0);
+  }*/
+  //in this case, we are creating a grayscale image
+  return 1;
+}
+
+
+void main()
+{
+    vec2 connecting=texCoords.st-contactPoint;
+    //far away from the impact point
+    if(length(connecting)>MAX_OFFSET+0.15){
+      discard;
+    }
+    //add perling noise loop th the the border of the impacted area
+    float x=dot(normalize(connecting), vec2(1,0));
+    float a= acos(x);
+    float y=sin(a);
+    //coud be any offset, just to have a more randomic shape
+    vec2 offset=vec2(x,y)+texCoords.st;
+    float noise= fbm(offset*1.7,1)*MAX_OFFSET;
+    if(length(connecting)>=noise+0.15){
+      discard;
+    }
+    FragColor=vec4(float(TurbulenceAAstep(power,contactPoint,1)));
+}
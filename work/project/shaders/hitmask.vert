@@ -0,0 +1,16 @@
+#version 410 core
+
+// the rectangle of the framebuffer passes (from -1 to 1) is scaled around the hit, to cover only the area it can affect
+layout (location = 0) in vec2 inPos;
+
+// position of the hit, and half size of the quad, in texture coordinates
+uniform vec2 contactPoint;
+uniform float extent;
+
+out vec2 texCoords;
+
+void main()
+{
+    texCoords = contactPoint + inPos * extent;
+    gl_Position = vec4(texCoords * 2.0 - 1.0, 0.0, 1.0);
+}
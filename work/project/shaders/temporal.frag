@@ -0,0 +1,45 @@
+#version 410 core
+
+// temporal accumulation of the blur: the blurred image of the previous frames (history) is reprojected to the current camera using the depth map,
+// and only a band of the frame is blurred again in each frame (the whole frame after new hits or large camera motions)
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+// blur of the current frame (up to date only in the refreshed band), and result of the previous frame
+uniform sampler2D currentTexture;
+uniform sampler2D historyTexture;
+uniform sampler2D zmap;
+
+// from the clip space of the current frame to the world space, and from the world space to the clip space of the previous frame
+uniform mat4 inverseViewProjection;
+uniform mat4 previousViewProjection;
+
+// band blurred again in this frame (range of the y texture coordinate), and weight of the history inside it
+uniform vec2 refreshedBand;
+uniform float feedback;
+
+void main()
+{
+  vec4 current = texture(currentTexture, texCoords.st);
+  bool refreshed = texCoords.t >= refreshedBand.x && texCoords.t < refreshedBand.y;
+  // the history is not read when the whole frame has been blurred again (it could be undefined)
+  if(refreshed && feedback <= 0.0){
+    FragColor = current;
+    return;
+  }
+
+  // position of the fragment in the world, and texture coordinates of the same position in the previous frame
+  float depth = texture(zmap, texCoords.st).r;
+  vec4 world = inverseViewProjection * vec4(vec3(texCoords.st, depth) * 2.0 - 1.0, 1.0);
+  vec4 previous = previousViewProjection * vec4(world.xyz / world.w, 1.0);
+  vec2 previousCoords = previous.xy / previous.w * 0.5 + 0.5;
+  // the position was outside the previous frame: we keep the last blur computed for this pixel
+  if(previous.w <= 0.0 || any(lessThan(previousCoords, vec2(0.0))) || any(greaterThan(previousCoords, vec2(1.0)))){
+    FragColor = current;
+    return;
+  }
+
+  vec4 history = texture(historyTexture, previousCoords);
+  FragColor = refreshed ? mix(current, history, feedback) : history;
+}
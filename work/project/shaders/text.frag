@@ -1,12 +1,16 @@
 #version 410 core
 in vec2 TexCoords;
+in vec3 textColor;
 out vec4 color;
 
+// atlas with the Signed Distance Fields of the glyphs (0.5 on the border of the glyph, > 0.5 inside)
 uniform sampler2D text;
-uniform vec3 textColor;
 
 void main()
 {    
-    vec4 sampled = vec4(1.0, 1.0, 1.0, texture(text, TexCoords).r);
-    color = vec4(textColor, 1.0) * sampled;
-}  
\ No newline at end of file
+    float distance = texture(text, TexCoords).r;
+    // the width of the antialiased border is the change of the distance between adjacent pixels, so the border is sharp at any scale
+    float width = fwidth(distance);
+    float alpha = smoothstep(0.5 - width, 0.5 + width, distance);
+    color = vec4(textColor, alpha);
+}
@@ -1,6 +1,8 @@
 #version 410 core
 layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
+layout (location = 1) in vec3 color;
 out vec2 TexCoords;
+out vec3 textColor;
 
 uniform mat4 projection;
 
@@ -8,4 +10,6 @@ void main()
 {
     gl_Position = projection * vec4(vertex.xy, 0.0, 1.0);
     TexCoords = vertex.zw;
-} 
\ No newline at end of file
+    // the color is in the vertices, so all the strings are drawn with a single draw call
+    textColor = color;
+}
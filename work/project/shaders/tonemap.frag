@@ -0,0 +1,27 @@
+#version 410 core
+
+// tonemapping of the HDR image (result of the mix pass) to the screen: the image is scaled by the exposure, and compressed with the ACES filmic curve (Narkowicz fit)
+// with the auto-exposure, the exposure brings the adapted average luminance (exposure.comp) to exposureKey
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+uniform sampler2D hdrTexture;
+uniform sampler2D averageLuminance;
+uniform bool autoExposure;
+uniform float exposureKey;
+// limits of the exposure
+uniform vec2 exposureRange;
+
+vec3 ACESFilm(vec3 x){
+  return clamp((x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14), 0.0, 1.0);
+}
+
+void main()
+{
+  vec3 color = texture(hdrTexture, texCoords.st).rgb;
+  float exposure = 1.0;
+  if(autoExposure)
+    exposure = clamp(exposureKey / max(texelFetch(averageLuminance, ivec2(0), 0).r, 1e-4), exposureRange.x, exposureRange.y);
+  FragColor = vec4(ACESFilm(color * exposure), 1.0);
+}
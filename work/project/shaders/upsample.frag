@@ -0,0 +1,25 @@
+#version 410 core
+
+// upsampling of an image to double resolution, for the blur pyramid (dual filter, Kawase style)
+// the 8 bilinear samples form a tent filter, which avoids the blocks of a simple bilinear magnification
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+// image to upsample, and size of its texels
+uniform sampler2D sourceTexture;
+uniform vec2 sourceTexelSize;
+
+void main()
+{
+  vec2 d = sourceTexelSize * 0.5;
+  vec4 color = texture(sourceTexture, texCoords + vec2(-2.0 * d.x, 0.0));
+  color += texture(sourceTexture, texCoords + vec2( 2.0 * d.x, 0.0));
+  color += texture(sourceTexture, texCoords + vec2(0.0, -2.0 * d.y));
+  color += texture(sourceTexture, texCoords + vec2(0.0,  2.0 * d.y));
+  color += texture(sourceTexture, texCoords + vec2(-d.x, -d.y)) * 2.0;
+  color += texture(sourceTexture, texCoords + vec2( d.x, -d.y)) * 2.0;
+  color += texture(sourceTexture, texCoords + vec2(-d.x,  d.y)) * 2.0;
+  color += texture(sourceTexture, texCoords + vec2( d.x,  d.y)) * 2.0;
+  FragColor = color / 12.0;
+}
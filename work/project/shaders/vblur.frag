@@ -1,26 +1,42 @@
 #version 420 core
 
 #define BLUR_SIZE 15
-#define width 800
-#define heigth 600
 
 out vec4 FragColor;
 in vec2 texCoords;
 
-//uniform int width;
-//uniform float heigth;
+// distance between two texels of the texture to sample (it depends on the size of the render targets)
+uniform vec2 texelSize;
 
 // texture with the original rendering
 uniform sampler2D screenTexture;
-uniform sampler2D immaginaryTexture;
+// with the DOF, screenTexture contains red and green of the component 0, and bokehTexture the other outputs of the horizontal pass (see hblur.frag)
+uniform sampler2D bokehTexture[4];
 uniform bool lumaTrick;
 
 vec2 getTexelUnit(){
-  vec2 unit= vec2(1./width,1./heigth);
-  return unit;
+  return texelSize;
 }
 
-float blurCoeff[31]={0.000012413329783081219,0.000040221571373342736,0.00012017860724662446,0.00033112430318893985,0.0008412952716973684,0.001971045418358334,0.004258265431659228,0.00848309004949083,0.015583274226409627,0.026396471051462745,0.04123028152882454,0.05938436230593951,0.07887067758612198,0.09659333160297948,0.10908490810935616,0.11359811921221667,0.10908490810935616,0.09659333160297948,0.07887067758612198,0.05938436230593951,0.04123028152882454,0.026396471051462745,0.015583274226409627,0.00848309004949083,0.004258265431659228,0.001971045418358334,0.0008412952716973684,0.00033112430318893985,0.00012017860724662446,0.000040221571373342736,0.000012413329783081219};
+// linear Gaussian kernel, generated on the CPU (gaussianKernel.h): x = offset in texels, y = weight
+// the first tap is the center, the others are fetched on both sides, between two texels (the bilinear filtering returns their weighted sum)
+#define GAUSSIAN_MAX_TAPS 32
+layout (std140, binding = 0) uniform GaussianKernel {
+  int tapCount;
+  int radius;
+  vec4 taps[GAUSSIAN_MAX_TAPS];
+  vec4 weights[GAUSSIAN_MAX_TAPS / 2];
+};
+// kernels of the components of DOFCircular, generated on the CPU (bokehKernel.h): kernel[c * KERNEL_SIZE + i].xy = real and imaginary part of the tap i of the component c
+// componentWeights[c].xy = weights of the real and imaginary part of the component c in the final result
+#define MAX_COMPONENTS 3
+#define KERNEL_SIZE (2 * BLUR_SIZE + 1)
+layout (std140, binding = 1) uniform BokehKernel {
+  int components;
+  vec4 componentWeights[MAX_COMPONENTS];
+  vec4 kernel[MAX_COMPONENTS * KERNEL_SIZE];
+};
+// DOFSquare uses a single component, with the bracketed kernel of this table
 const vec4 Kernel0BracketsRealXY_ImZW = vec4(-0.000776,0.680418,0.000000,0.302524);
 const vec2 Kernel0Weights_RealX_ImY = vec2(0.767583,1.862321);
 const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
@@ -56,7 +72,6 @@ const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
         vec4(/*XY: Non Bracketed*/0.002486,0.015868,/*Bracketed WZ:*/0.004794,0.052452),
         vec4(/*XY: Non Bracketed*/-0.000776,0.014351,/*Bracketed WZ:*/0.000000,0.047438)
 );
-//float blurCoeff[61]={0.00047108753187090845,0.0006299954542634891,0.0008342476118513276,0.0010938911084409344,0.0014202820421456586,0.0018259812420950796,0.0023245510069993323,0.002930237054811048,0.00365752422443188,0.004520561042608063,0.005532457051297556,0.0067044675016952465,0.008045092096580709,0.009559127051781698,0.011246721745323141,0.013102501343509586,0.015114823683117182,0.017265241071896104,0.019528234511337204,0.021871278517810892,0.02425527914005976,0.02663540650524366,0.02896231750779124,0.031183735942891172,0.03324632882505008,0.03509779144363722,0.03668903252214707,0.037976337009618694,0.03892337931271162,0.03950296513759527,0.03969824751877432,0.03950296513759527,0.03892337931271162,0.037976337009618694,0.03668903252214707,0.03509779144363722,0.03324632882505008,0.031183735942891172,0.02896231750779124,0.02663540650524366,0.02425527914005976,0.021871278517810892,0.019528234511337204,0.017265241071896104,0.015114823683117182,0.013102501343509586,0.011246721745323141,0.009559127051781698,0.008045092096580709,0.0067044675016952465,0.005532457051297556,0.004520561042608063,0.00365752422443188,0.002930237054811048,0.0023245510069993323,0.0018259812420950796,0.0014202820421456586,0.0010938911084409344,0.0008342476118513276,0.0006299954542634891,0.00047108753187090845};
 /////////////////////////////////////////////////////////////////////
 
 //(Pr+Pi)*(Qr+Qi) = (Pr*Qr+Pr*Qi+Pi*Qr-Pi*Qi)
@@ -75,13 +90,10 @@ subroutine uniform blur_model Blur_Model;
 subroutine(blur_model)
 vec3 GaussianBlur(){
   vec2 unit=getTexelUnit();
-  vec4 color=vec4(0);
-  
-  for(int i=0;i<=2*BLUR_SIZE;i++ ){
-    float y_offset=((i-BLUR_SIZE)*unit.y);
-    //float y_offset=texCoords.x+((float)(i-BLUR_SIZE)*unit.x);
-    vec2 offset= vec2(0.0,y_offset);
-    color+=texture(screenTexture, texCoords.st+offset)*blurCoeff[i];
+  vec4 color=texture(screenTexture, texCoords.st)*taps[0].y;
+  for(int i=1;i<tapCount;i++){
+    vec2 offset=vec2(0.0,taps[i].x*unit.y);
+    color+=(texture(screenTexture, texCoords.st+offset)+texture(screenTexture, texCoords.st-offset))*taps[i].y;
   }
   return vec3(color);
 }
@@ -100,68 +112,60 @@ vec3 NonGaussianBlur(){
   return vec3(color)*(1.0f/float(lineSize));
 }
 
-subroutine(blur_model)
-vec3 DOFCircular(){
+// vertical pass of the bokeh: complex product of the result of the horizontal pass with the kernel, and weighted sum of the real and imaginary parts of the components
+vec3 bokehVertical(bool square){
     vec2 unit = getTexelUnit();
-    vec2 valR = vec2(0.0,0.0); //img and real part
-    vec2 valG = vec2(0.0,0.0);
-    vec2 valB = vec2(0.0,0.0);
+    int count = square ? 1 : components;
+    vec2 valR[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0)); //img and real part
+    vec2 valG[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0));
+    vec2 valB[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0));
     for (int i=-BLUR_SIZE; i <=BLUR_SIZE; ++i)
     {
         vec2 coords = texCoords + unit*vec2(0.0,float(i));
-        vec3 realTexel = vec3(texture(screenTexture, coords));  
-        vec3 imaginaryTexel = vec3(texture(immaginaryTexture, coords));  
-        
-        vec2 c0 = Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].xy;
-        
-        
-        valR += multComplex(vec2(realTexel.r, imaginaryTexel.r),c0);
-        valG += multComplex(vec2(realTexel.g, imaginaryTexel.g),c0);
-        valB += multComplex(vec2(realTexel.b, imaginaryTexel.b),c0);
-    
+        // the textures of the components not used are not read
+        vec4 redGreen[MAX_COMPONENTS];
+        vec2 blue[MAX_COMPONENTS];
+        redGreen[0] = texture(screenTexture, coords);
+        vec4 blue01 = texture(bokehTexture[0], coords);
+        blue[0] = blue01.xy;
+        if(count > 1){
+            redGreen[1] = texture(bokehTexture[1], coords);
+            blue[1] = blue01.zw;
+        }
+        if(count > 2){
+            redGreen[2] = texture(bokehTexture[2], coords);
+            blue[2] = texture(bokehTexture[3], coords).xy;
+        }
+        for (int c=0; c<count; c++)
+        {
+            vec2 c0 = square ? Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].zw : kernel[c*KERNEL_SIZE+i+BLUR_SIZE].xy;
+            valR[c] += multComplex(redGreen[c].xy, c0);
+            valG[c] += multComplex(redGreen[c].zw, c0);
+            valB[c] += multComplex(blue[c], c0);
+        }
+    }
+
+    vec3 result = vec3(0.0);
+    for (int c=0; c<count; c++)
+    {
+        vec2 combination = square ? Kernel0BracketsRealXY_ImZW.xy : componentWeights[c].xy;
+        result += vec3(dot(valR[c],combination), dot(valG[c],combination), dot(valB[c],combination));
     }
-    
-    float redChannel   = dot(valR,Kernel0Weights_RealX_ImY);
-    float greenChannel = dot(valG,Kernel0Weights_RealX_ImY);
-    float blueChannel  = dot(valB,Kernel0Weights_RealX_ImY);
     if(lumaTrick){
-      return sqrt(vec3(redChannel,greenChannel,blueChannel));  
+      return sqrt(max(result, vec3(0.0)));
     }else{
-      return (vec3(redChannel,greenChannel,blueChannel));  
+      return result;
     }
 }
 
+subroutine(blur_model)
+vec3 DOFCircular(){
+    return bokehVertical(false);
+}
 
 subroutine(blur_model)
 vec3 DOFSquare(){
-    vec2 unit = getTexelUnit();
-    vec2 valR = vec2(0.0,0.0); //img and real part
-    vec2 valG = vec2(0.0,0.0);
-    vec2 valB = vec2(0.0,0.0);
-    float filterRadius = BLUR_SIZE;
-    for (int i=-BLUR_SIZE; i <=BLUR_SIZE; ++i)
-    {
-        vec2 coords = texCoords + unit*vec2(0.0,float(i));
-        vec3 realTexel = vec3(texture(screenTexture, coords));  
-        vec3 imaginaryTexel = vec3(texture(immaginaryTexture, coords));  
-        
-        vec2 c0 = Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].zw;
-        
-        
-        valR += multComplex(vec2(realTexel.r, imaginaryTexel.r),c0);
-        valG += multComplex(vec2(realTexel.g, imaginaryTexel.g),c0);
-        valB += multComplex(vec2(realTexel.b, imaginaryTexel.b),c0);
-    
-    }
-    vec2 magic=Kernel0BracketsRealXY_ImZW.xy;
-    float redChannel   = dot(valR,magic);
-    float greenChannel = dot(valG,magic);
-    float blueChannel  = dot(valB,magic);
-    if(lumaTrick){
-      return sqrt((vec3(redChannel,greenChannel,blueChannel)));  
-    }else{
-      return (vec3(redChannel,greenChannel,blueChannel));  
-    }
+    return bokehVertical(true);
 }
 
 void main()
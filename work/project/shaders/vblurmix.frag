@@ -0,0 +1,234 @@
+#version 420 core
+
+// vertical blur and mix in a single pass (vblur.frag + mix.frag): the mix value is computed first, and the vertical convolution is evaluated only where it is > 0
+// the result of the vertical blur is not written to a target and read again by the mix pass
+
+#define BLUR_SIZE 15
+#define transition_space 0.10
+
+out vec4 FragColor;
+in vec2 texCoords;
+
+// distance between two texels of the blur targets (it depends on the render scale)
+uniform vec2 texelSize;
+
+// result of the horizontal pass
+uniform sampler2D horizontalTexture;
+// with the DOF, horizontalTexture contains red and green of the component 0, and bokehTexture the other outputs of the horizontal pass (see hblur.frag)
+uniform sampler2D bokehTexture[4];
+uniform bool lumaTrick;
+
+uniform int life;
+uniform bool redOverlay;
+// texture with the original rendering
+uniform sampler2D screenTexture;
+uniform sampler2D zmap;
+// areas of the screen covered by the hits (1 = blurred)
+uniform sampler2D hitMask;
+
+vec2 getTexelUnit(){
+  return texelSize;
+}
+
+// linear Gaussian kernel, generated on the CPU (gaussianKernel.h): x = offset in texels, y = weight
+// the first tap is the center, the others are fetched on both sides, between two texels (the bilinear filtering returns their weighted sum)
+#define GAUSSIAN_MAX_TAPS 32
+layout (std140, binding = 0) uniform GaussianKernel {
+  int tapCount;
+  int radius;
+  vec4 taps[GAUSSIAN_MAX_TAPS];
+  vec4 weights[GAUSSIAN_MAX_TAPS / 2];
+};
+// kernels of the components of DOFCircular, generated on the CPU (bokehKernel.h): kernel[c * KERNEL_SIZE + i].xy = real and imaginary part of the tap i of the component c
+// componentWeights[c].xy = weights of the real and imaginary part of the component c in the final result
+#define MAX_COMPONENTS 3
+#define KERNEL_SIZE (2 * BLUR_SIZE + 1)
+layout (std140, binding = 1) uniform BokehKernel {
+  int components;
+  vec4 componentWeights[MAX_COMPONENTS];
+  vec4 kernel[MAX_COMPONENTS * KERNEL_SIZE];
+};
+// DOFSquare uses a single component, with the bracketed kernel of this table
+const vec4 Kernel0BracketsRealXY_ImZW = vec4(-0.000776,0.680418,0.000000,0.302524);
+const vec2 Kernel0Weights_RealX_ImY = vec2(0.767583,1.862321);
+const vec4 Kernel0_RealX_ImY_RealZ_ImW[] = vec4[](
+        vec4(/*XY: Non Bracketed*/-0.000776,0.014351,/*Bracketed WZ:*/0.000000,0.047438),
+        vec4(/*XY: Non Bracketed*/0.002486,0.015868,/*Bracketed WZ:*/0.004794,0.052452),
+        vec4(/*XY: Non Bracketed*/0.006114,0.016730,/*Bracketed WZ:*/0.010127,0.055303),
+        vec4(/*XY: Non Bracketed*/0.009926,0.016905,/*Bracketed WZ:*/0.015728,0.055881),
+        vec4(/*XY: Non Bracketed*/0.013744,0.016417,/*Bracketed WZ:*/0.021340,0.054266),
+        vec4(/*XY: Non Bracketed*/0.017413,0.015338,/*Bracketed WZ:*/0.026732,0.050701),
+        vec4(/*XY: Non Bracketed*/0.020808,0.013780,/*Bracketed WZ:*/0.031722,0.045551),
+        vec4(/*XY: Non Bracketed*/0.023843,0.011878,/*Bracketed WZ:*/0.036183,0.039262),
+        vec4(/*XY: Non Bracketed*/0.026466,0.009777,/*Bracketed WZ:*/0.040037,0.032317),
+        vec4(/*XY: Non Bracketed*/0.028659,0.007623,/*Bracketed WZ:*/0.043260,0.025198),
+        vec4(/*XY: Non Bracketed*/0.030429,0.005554,/*Bracketed WZ:*/0.045863,0.018359),
+        vec4(/*XY: Non Bracketed*/0.031804,0.003691,/*Bracketed WZ:*/0.047883,0.012201),
+        vec4(/*XY: Non Bracketed*/0.032819,0.002136,/*Bracketed WZ:*/0.049374,0.007061),
+        vec4(/*XY: Non Bracketed*/0.033511,0.000968,/*Bracketed WZ:*/0.050391,0.003201),
+        vec4(/*XY: Non Bracketed*/0.033911,0.000245,/*Bracketed WZ:*/0.050980,0.000810),
+        vec4(/*XY: Non Bracketed*/0.034043,0.000000,/*Bracketed WZ:*/0.051173,0.000000),
+        vec4(/*XY: Non Bracketed*/0.033911,0.000245,/*Bracketed WZ:*/0.050980,0.000810),
+        vec4(/*XY: Non Bracketed*/0.033511,0.000968,/*Bracketed WZ:*/0.050391,0.003201),
+        vec4(/*XY: Non Bracketed*/0.032819,0.002136,/*Bracketed WZ:*/0.049374,0.007061),
+        vec4(/*XY: Non Bracketed*/0.031804,0.003691,/*Bracketed WZ:*/0.047883,0.012201),
+        vec4(/*XY: Non Bracketed*/0.030429,0.005554,/*Bracketed WZ:*/0.045863,0.018359),
+        vec4(/*XY: Non Bracketed*/0.028659,0.007623,/*Bracketed WZ:*/0.043260,0.025198),
+        vec4(/*XY: Non Bracketed*/0.026466,0.009777,/*Bracketed WZ:*/0.040037,0.032317),
+        vec4(/*XY: Non Bracketed*/0.023843,0.011878,/*Bracketed WZ:*/0.036183,0.039262),
+        vec4(/*XY: Non Bracketed*/0.020808,0.013780,/*Bracketed WZ:*/0.031722,0.045551),
+        vec4(/*XY: Non Bracketed*/0.017413,0.015338,/*Bracketed WZ:*/0.026732,0.050701),
+        vec4(/*XY: Non Bracketed*/0.013744,0.016417,/*Bracketed WZ:*/0.021340,0.054266),
+        vec4(/*XY: Non Bracketed*/0.009926,0.016905,/*Bracketed WZ:*/0.015728,0.055881),
+        vec4(/*XY: Non Bracketed*/0.006114,0.016730,/*Bracketed WZ:*/0.010127,0.055303),
+        vec4(/*XY: Non Bracketed*/0.002486,0.015868,/*Bracketed WZ:*/0.004794,0.052452),
+        vec4(/*XY: Non Bracketed*/-0.000776,0.014351,/*Bracketed WZ:*/0.000000,0.047438)
+);
+/////////////////////////////////////////////////////////////////////
+
+//(Pr+Pi)*(Qr+Qi) = (Pr*Qr+Pr*Qi+Pi*Qr-Pi*Qi)
+vec2 multComplex(vec2 p, vec2 q)
+{
+    return vec2(p.x*q.x-p.y*q.y, p.x*q.y+p.y*q.x);
+}
+
+// the "type" of the Subroutine
+subroutine vec3 blur_model();
+
+// Subroutine Uniform (it is conceptually similar to a C pointer function)
+subroutine uniform blur_model Blur_Model;
+
+
+subroutine(blur_model)
+vec3 GaussianBlur(){
+  vec2 unit=getTexelUnit();
+  vec4 color=texture(horizontalTexture, texCoords.st)*taps[0].y;
+  for(int i=1;i<tapCount;i++){
+    vec2 offset=vec2(0.0,taps[i].x*unit.y);
+    color+=(texture(horizontalTexture, texCoords.st+offset)+texture(horizontalTexture, texCoords.st-offset))*taps[i].y;
+  }
+  return vec3(color);
+}
+
+subroutine(blur_model)
+vec3 NonGaussianBlur(){
+  vec2 unit=getTexelUnit();
+  vec4 color=vec4(0);
+  int lineSize=(2*BLUR_SIZE)+1;
+  for(int i=0;i<=2*BLUR_SIZE;i++ ){
+    float y_offset=((i-BLUR_SIZE)*unit.y);
+    //float y_offset=texCoords.x+((float)(i-BLUR_SIZE)*unit.x);
+    vec2 offset= vec2(0.0,y_offset);
+    color+=texture(horizontalTexture, texCoords.st+offset);
+  }
+  return vec3(color)*(1.0f/float(lineSize));
+}
+
+// vertical pass of the bokeh: complex product of the result of the horizontal pass with the kernel, and weighted sum of the real and imaginary parts of the components
+vec3 bokehVertical(bool square){
+    vec2 unit = getTexelUnit();
+    int count = square ? 1 : components;
+    vec2 valR[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0)); //img and real part
+    vec2 valG[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0));
+    vec2 valB[MAX_COMPONENTS] = vec2[](vec2(0.0), vec2(0.0), vec2(0.0));
+    for (int i=-BLUR_SIZE; i <=BLUR_SIZE; ++i)
+    {
+        vec2 coords = texCoords + unit*vec2(0.0,float(i));
+        // the textures of the components not used are not read
+        vec4 redGreen[MAX_COMPONENTS];
+        vec2 blue[MAX_COMPONENTS];
+        redGreen[0] = texture(horizontalTexture, coords);
+        vec4 blue01 = texture(bokehTexture[0], coords);
+        blue[0] = blue01.xy;
+        if(count > 1){
+            redGreen[1] = texture(bokehTexture[1], coords);
+            blue[1] = blue01.zw;
+        }
+        if(count > 2){
+            redGreen[2] = texture(bokehTexture[2], coords);
+            blue[2] = texture(bokehTexture[3], coords).xy;
+        }
+        for (int c=0; c<count; c++)
+        {
+            vec2 c0 = square ? Kernel0_RealX_ImY_RealZ_ImW[i+BLUR_SIZE].zw : kernel[c*KERNEL_SIZE+i+BLUR_SIZE].xy;
+            valR[c] += multComplex(redGreen[c].xy, c0);
+            valG[c] += multComplex(redGreen[c].zw, c0);
+            valB[c] += multComplex(blue[c], c0);
+        }
+    }
+
+    vec3 result = vec3(0.0);
+    for (int c=0; c<count; c++)
+    {
+        vec2 combination = square ? Kernel0BracketsRealXY_ImZW.xy : componentWeights[c].xy;
+        result += vec3(dot(valR[c],combination), dot(valG[c],combination), dot(valB[c],combination));
+    }
+    if(lumaTrick){
+      return sqrt(max(result, vec3(0.0)));
+    }else{
+      return result;
+    }
+}
+
+subroutine(blur_model)
+vec3 DOFCircular(){
+    return bokehVertical(false);
+}
+
+subroutine(blur_model)
+vec3 DOFSquare(){
+    return bokehVertical(true);
+}
+
+/////////////////////////////////////////////////////////////////////
+// the "type" of the Subroutine
+subroutine float mix_model(); //false screentexture, true blurtexture
+
+// Subroutine Uniform (it is conceptually similar to a C pointer function)
+subroutine uniform mix_model Mix_Model;
+
+
+subroutine(mix_model)
+float FullBlur(){
+  return 1.0;
+}
+
+subroutine(mix_model)
+float NoBlur(){
+  return 0.0;
+}
+
+// the areas of the hits are rendered in the hit mask (hitmask.frag) only when the hits change
+subroutine(mix_model)
+float Splash(){
+  return texture(hitMask, texCoords.st).r;
+}
+
+subroutine(mix_model)
+float Distance(){
+  float depth=clamp(((texture(zmap, texCoords.st).r)-.98)*50.,0.0f,1.0);
+  float deathZone= float(life)/100.0;
+  if(depth>deathZone){
+    return 1.0;
+  }//not a good result :) 
+  if(depth> deathZone-transition_space &&deathZone!=1){
+    return (depth-(deathZone-transition_space))/transition_space;
+  }
+  return 0.0;
+}
+
+void main()
+{
+  vec4 color = texture(screenTexture, texCoords.st);
+  float mix_value=Mix_Model();
+  if(mix_value<=0.0){
+    FragColor=color;
+    return;
+  }
+  vec4 blur=vec4(Blur_Model(),1);
+ if(redOverlay){
+    vec4 red= vec4(1,0,0,1);
+    blur=mix(blur,red,0.15);
+  }
+  FragColor=mix(color,blur,mix_value);
+}
@@ -0,0 +1,9 @@
+@echo off
+IF EXIST "C:\Program Files (x86)\Microsoft Visual Studio\2019\BuildTools\VC\Auxiliary\Build\vcvarsall.bat" (
+    call "C:\Program Files (x86)\Microsoft Visual Studio\2019\BuildTools\VC\Auxiliary\Build\vcvarsall.bat" x64
+) ELSE (
+    call "C:\Program Files (x86)\Microsoft Visual Studio\2019\Community\VC\Auxiliary\Build\vcvarsall.bat" x64
+)
+set compilerflags=/O2 /EHsc /MT
+set includedirs=/I../../include
+cl.exe %compilerflags% %includedirs% texcompress.cpp /Fe:texcompress.exe
@@ -0,0 +1,115 @@
+/*
+texcompress
+- offline tool converting the 6 images of a cube map to a single KTX file, with all the mip levels compressed in BC7 (see textureCompressor.h)
+- the application loads the "cubemap.ktx" file, if it is present in the folder of the cube map, instead of decoding the images
+
+usage: texcompress <folder of the cube map> [format of the images, default jpg]
+e.g.:  texcompress ../../textures/cube/uffizi/ png
+
+The images must be named "posx, negx, posy, negy, posz, negz", and they must be square and with the same size.
+At the end, we decode the compressed blocks of the first level, and we print the PSNR of each face, to check the quality of the compression.
+*/
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <chrono>
+
+// we include the library for images loading
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image/stb_image.h>
+
+#include <utils/textureCompressor.h>
+
+// PSNR of the decoded BC7 image with respect to the original RGB image
+double PSNR(const vector<unsigned char>& blocks, const unsigned char* pixels, int width, int height)
+{
+    int bw = (width + 3) / 4;
+    double error = 0.0;
+    unsigned char decoded[64];
+    for(int y = 0; y < height; y += 4)
+        for(int x = 0; x < width; x += 4){
+            TextureCompressor::DecodeBC7Block(&blocks[((size_t)(y / 4) * bw + x / 4) * 16], decoded);
+            for(int j = 0; j < 4 && y + j < height; j++)
+                for(int i = 0; i < 4 && x + i < width; i++)
+                    for(int c = 0; c < 3; c++){
+                        double d = (double)decoded[(j * 4 + i) * 4 + c] - pixels[((size_t)(y + j) * width + x + i) * 3 + c];
+                        error += d * d;
+                    }
+        }
+    error /= (double)width * height * 3.0;
+    return error > 0.0 ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2){
+        std::cout << "usage: texcompress <folder of the cube map> [format of the images]" << std::endl;
+        return 1;
+    }
+    string path = argv[1];
+    if(path.back() != '/' && path.back() != '\\')
+        path += "/";
+    string format = argc > 2 ? argv[2] : "jpg";
+
+    const char* sides[6] = {"posx.", "negx.", "posy.", "negy.", "posz.", "negz."};
+    auto start = std::chrono::steady_clock::now();
+
+    CompressedTexture tex;
+    tex.internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+    tex.faces = 6;
+    vector<vector<vector<unsigned char> > > faces(6);
+    for(int s = 0; s < 6; s++){
+        string fullname = path + sides[s] + format;
+        int w, h;
+        unsigned char* image = stbi_load(fullname.c_str(), &w, &h, 0, STBI_rgb);
+        if(image == nullptr){
+            std::cout << "Failed to load " << fullname << std::endl;
+            return 1;
+        }
+        if(s == 0){
+            tex.width = w;
+            tex.height = h;
+            tex.levels = TextureCompressor::MipLevels(w, h);
+        }
+        if(w != h || w != tex.width || h != tex.height){
+            std::cout << "The sides of the cube map must be square and with the same size" << std::endl;
+            stbi_image_free(image);
+            return 1;
+        }
+
+        // we compress the full mip chain of the face
+        vector<unsigned char> level(image, image + (size_t)w * h * 3);
+        faces[s].push_back(TextureCompressor::CompressBC7(&level[0], w, h, 3));
+        std::cout << sides[s] << format << ": PSNR " << PSNR(faces[s][0], image, w, h) << " dB" << std::endl;
+        stbi_image_free(image);
+        for(int l = 1; l < tex.levels; l++){
+            int nw, nh;
+            level = TextureCompressor::Downsample(&level[0], w, h, 3, nw, nh);
+            w = nw;
+            h = nh;
+            faces[s].push_back(TextureCompressor::CompressBC7(&level[0], w, h, 3));
+        }
+    }
+
+    // in the file, the images are stored level by level
+    for(int l = 0; l < tex.levels; l++)
+        for(int s = 0; s < 6; s++)
+            tex.images.push_back(faces[s][l]);
+
+    string output = path + "cubemap.ktx";
+    if(!TextureCompressor::WriteKTX(output, tex)){
+        std::cout << "Failed to write " << output << std::endl;
+        return 1;
+    }
+
+    size_t compressedBytes = 0;
+    for(size_t i = 0; i < tex.images.size(); i++)
+        compressedBytes += tex.images[i].size();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << output << ": " << tex.width << "x" << tex.height << ", " << tex.levels << " levels, "
+              << compressedBytes / 1024 << " KB (RGB8 level 0 only: " << (size_t)tex.width * tex.height * 3 * 6 / 1024 << " KB), "
+              << ms << " ms" << std::endl;
+    return 0;
+}